@@ -0,0 +1,131 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace bc
+{
+
+// Node-wide table of wallet addresses. Every distinct address string is
+// stored once and identified by a 32-bit id. Entries are never removed.
+class AddressTable
+{
+public:
+  static AddressTable &instance()
+  {
+    static AddressTable table;
+    return table;
+  }
+
+  std::size_t size() const
+  {
+    std::shared_lock lock { m_mtx };
+
+    return m_addresses.size();
+  }
+
+  uint32_t intern(std::string_view address)
+  {
+    if (auto id { find(address) })
+      return *id;
+
+    std::unique_lock lock { m_mtx };
+
+    if (auto it { m_ids.find(address) }; it != m_ids.end())
+      return it->second;
+
+    uint32_t id = m_addresses.size();
+
+    // Deque elements never move, the keys can refer to them.
+    m_ids.emplace(m_addresses.emplace_back(address), id);
+
+    return id;
+  }
+
+  std::optional<uint32_t> find(std::string_view address) const
+  {
+    std::shared_lock lock { m_mtx };
+
+    auto it { m_ids.find(address) };
+    if (it == m_ids.end())
+      return std::nullopt;
+
+    return it->second;
+  }
+
+  std::string const &resolve(uint32_t id) const
+  {
+    std::shared_lock lock { m_mtx };
+
+    return m_addresses[id];
+  }
+
+private:
+  std::deque<std::string> m_addresses;
+  std::unordered_map<std::string_view, uint32_t> m_ids;
+
+  mutable std::shared_mutex m_mtx;
+};
+
+// Wallet address, interned in the node-wide address table. Since entries are
+// never removed, only addresses of admitted transactions should be interned,
+// see Transaction::UTxO.
+class Address
+{
+public:
+  Address(std::string const &address)
+  : m_id { AddressTable::instance().intern(address) }
+  {}
+
+  // Looks up an address without interning it.
+  static std::optional<Address> find(std::string_view address)
+  {
+    auto id { AddressTable::instance().find(address) };
+    if (!id)
+      return std::nullopt;
+
+    return Address { *id };
+  }
+
+  bool operator==(Address const &other) const
+  { return m_id == other.m_id; }
+
+  auto operator<=>(Address const &other) const
+  { return m_id <=> other.m_id; }
+
+  uint32_t id() const
+  { return m_id; }
+
+  std::string const &to_string() const
+  { return AddressTable::instance().resolve(m_id); }
+
+private:
+  explicit Address(uint32_t id)
+  : m_id { id }
+  {}
+
+  uint32_t m_id;
+};
+
+} // end namespace bc
+
+namespace std
+{
+
+template<>
+struct hash<bc::Address>
+{
+  std::size_t operator()(bc::Address const &address) const
+  { return hash<uint32_t>()(address.id()); }
+};
+
+} // end namespace std
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "crypto/digest.h"
+#include "format.h"
+#include "json.h"
+#include "nix.h"
+#include "thread_pool.h"
+
+namespace bc
+{
+
+// Append-only on-disk block store. Blocks are CBOR encoded and appended to
+// segment files in a directory, each record is prefixed by the payload size
+// and the block hash so that the index from heights and hashes to file
+// offsets can be rebuilt on startup without decoding any blocks.
+//
+// Not thread safe, callers are expected to serialize access.
+template<typename BLOCK>
+class BlockStore
+{
+  struct Location
+  {
+    std::size_t segment;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+public:
+  explicit BlockStore(std::filesystem::path dir)
+  : m_dir { std::move(dir) }
+  {
+    std::filesystem::create_directories(m_dir);
+
+    for (std::size_t segment { 0 }; std::filesystem::exists(segment_path(segment)); ++segment)
+      scan(segment);
+
+    if (m_segment_fd == -1)
+      open_segment(0);
+  }
+
+  BlockStore(BlockStore const &) = delete;
+  BlockStore &operator=(BlockStore const &) = delete;
+
+  ~BlockStore()
+  {
+    if (m_segment_fd == -1)
+      return;
+
+    ::fsync(m_segment_fd);
+    ::close(m_segment_fd);
+  }
+
+  std::size_t size() const
+  { return m_locations.size(); }
+
+  Digest const &hash(uint64_t height) const
+  { return m_hashes.at(height); }
+
+  std::optional<uint64_t> find(Digest const &hash) const
+  {
+    auto it { m_heights.find(hash) };
+    if (it == m_heights.end())
+      return std::nullopt;
+
+    return it->second;
+  }
+
+  BLOCK read(uint64_t height) const
+  {
+    auto const &loc { m_locations.at(height) };
+
+    std::vector<uint8_t> payload(loc.size);
+
+    int fd { ::open(segment_path(loc.segment).c_str(), O_RDONLY) };
+    if (fd == -1)
+      throw_errno("failed to open segment");
+
+    bool ok { read_exact(fd, loc.offset, payload.data(), payload.size()) };
+
+    ::close(fd);
+
+    if (!ok)
+      throw std::runtime_error(fmt::format("failed to read block {}", height));
+
+    return BLOCK::from_json(json::from_cbor(payload));
+  }
+
+  // Passes all blocks to 'func' in order. Segments are memory mapped and
+  // blocks are decoded straight from the mapped region, several at a time in
+  // parallel, so that only a small batch of decoded blocks exists at once.
+  template<typename FUNC>
+  void for_each(FUNC &&func) const
+  {
+    auto batch_size { DECODE_BATCH_SIZE * ThreadPool::instance().size() };
+
+    std::vector<std::optional<BLOCK>> batch;
+
+    uint64_t height { 0 };
+
+    while (height < m_locations.size()) {
+      auto segment { m_locations[height].segment };
+
+      nix::MappedFile mapped { segment_path(segment) };
+
+      auto segment_end { height };
+      while (segment_end < m_locations.size() && m_locations[segment_end].segment == segment)
+        ++segment_end;
+
+      while (height < segment_end) {
+        batch.clear();
+        batch.resize(std::min(batch_size, segment_end - height));
+
+        ThreadPool::instance().parallel_for(batch.size(), [&](std::size_t i){
+          auto const &loc { m_locations[height + i] };
+
+          if (loc.offset + loc.size > mapped.size())
+            throw std::runtime_error(fmt::format("failed to read block {}", height + i));
+
+          auto begin { mapped.data() + loc.offset };
+
+          batch[i].emplace(BLOCK::from_json(json::from_cbor(begin, begin + loc.size)));
+        });
+
+        for (auto &block : batch)
+          func(std::move(*block));
+
+        height += batch.size();
+      }
+    }
+  }
+
+  void append(BLOCK const &block)
+  {
+    if (block.index() != m_locations.size())
+      throw std::logic_error(
+        fmt::format("attempted storing block {} at height {}", block.index(), m_locations.size()));
+
+    auto payload { json::to_cbor(block.to_json()) };
+    auto hash { block.hash() };
+
+    std::vector<uint8_t> record;
+    record.reserve(HEADER_SIZE + hash.length() + payload.size());
+
+    auto size { static_cast<uint32_t>(payload.size()) };
+    auto hash_length { static_cast<uint8_t>(hash.length()) };
+
+    record.insert(record.end(),
+                  reinterpret_cast<uint8_t const *>(&size),
+                  reinterpret_cast<uint8_t const *>(&size) + sizeof(size));
+    record.push_back(hash_length);
+    record.insert(record.end(), hash.data(), hash.data() + hash.length());
+    record.insert(record.end(), payload.begin(), payload.end());
+
+    if (m_segment_size > 0 && m_segment_size + record.size() > config().store_segment_size_max) {
+      sync();
+      open_segment(m_segment + 1);
+    }
+
+    if (!write_exact(m_segment_fd, m_segment_size, record.data(), record.size()))
+      throw_errno("failed to write block");
+
+    add(hash, m_segment_size + HEADER_SIZE + hash.length(), payload.size());
+
+    m_segment_size += record.size();
+
+    if (++m_unsynced >= config().store_sync_after)
+      sync();
+  }
+
+  // Drop all blocks from the given height onwards, e.g. after the chain has
+  // been replaced by a longer fork.
+  void truncate(uint64_t height)
+  {
+    if (height >= m_locations.size())
+      return;
+
+    auto segment { m_locations[height].segment };
+    auto offset { m_locations[height].offset - HEADER_SIZE - m_hashes[height].length() };
+
+    for (auto i { m_locations.size() }; i-- > height;) {
+      m_heights.erase(m_hashes[i]);
+      m_hashes.pop_back();
+      m_locations.pop_back();
+    }
+
+    ::close(m_segment_fd);
+    m_segment_fd = -1;
+
+    for (auto i { segment + 1 }; i <= m_segment; ++i)
+      std::filesystem::remove(segment_path(i));
+
+    open_segment(segment);
+
+    if (::ftruncate(m_segment_fd, offset) == -1)
+      throw_errno("failed to truncate segment");
+
+    m_segment_size = offset;
+
+    sync();
+  }
+
+  void sync()
+  {
+    if (::fsync(m_segment_fd) == -1)
+      throw_errno("failed to sync segment");
+
+    m_unsynced = 0;
+  }
+
+private:
+  // Number of blocks decoded per thread at once while iterating.
+  static constexpr std::size_t DECODE_BATCH_SIZE = 64;
+
+  // Payload size and hash length.
+  static constexpr std::size_t HEADER_SIZE = sizeof(uint32_t) + sizeof(uint8_t);
+
+  std::filesystem::path segment_path(std::size_t segment) const
+  { return m_dir / fmt::format("blocks_{:05}.dat", segment); }
+
+  void open_segment(std::size_t segment)
+  {
+    if (m_segment_fd != -1)
+      ::close(m_segment_fd);
+
+    m_segment_fd = ::open(segment_path(segment).c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_segment_fd == -1)
+      throw_errno("failed to open segment");
+
+    m_segment = segment;
+    m_segment_size = 0;
+  }
+
+  void scan(std::size_t segment)
+  {
+    open_segment(segment);
+
+    std::size_t offset { 0 };
+
+    for (;;) {
+      uint8_t header[HEADER_SIZE];
+      if (!read_exact(m_segment_fd, offset, header, HEADER_SIZE))
+        break;
+
+      uint32_t size;
+      std::memcpy(&size, header, sizeof(size));
+
+      uint8_t hash_length { header[sizeof(size)] };
+
+      std::vector<uint8_t> hash(hash_length);
+      if (!read_exact(m_segment_fd, offset + HEADER_SIZE, hash.data(), hash.size()))
+        break;
+
+      auto end { offset + HEADER_SIZE + hash_length + size };
+
+      // Incomplete trailing records are left behind by crashes mid-write.
+      if (end > static_cast<std::size_t>(::lseek(m_segment_fd, 0, SEEK_END)))
+        break;
+
+      add(Digest { hash }, offset + HEADER_SIZE + hash_length, size);
+
+      offset = end;
+    }
+
+    if (::ftruncate(m_segment_fd, offset) == -1)
+      throw_errno("failed to truncate segment");
+
+    m_segment_size = offset;
+  }
+
+  void add(Digest const &hash, std::size_t offset, std::size_t size)
+  {
+    m_heights[hash] = m_locations.size();
+    m_hashes.push_back(hash);
+    m_locations.push_back({ m_segment, offset, size });
+  }
+
+  static bool read_exact(int fd, std::size_t offset, uint8_t *buf, std::size_t size)
+  {
+    while (size > 0) {
+      auto n { ::pread(fd, buf, size, offset) };
+      if (n <= 0)
+        return false;
+
+      buf += n;
+      offset += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  static bool write_exact(int fd, std::size_t offset, uint8_t const *buf, std::size_t size)
+  {
+    while (size > 0) {
+      auto n { ::pwrite(fd, buf, size, offset) };
+      if (n <= 0)
+        return false;
+
+      buf += n;
+      offset += n;
+      size -= n;
+    }
+
+    return true;
+  }
+
+  [[noreturn]] static void throw_errno(std::string const &what)
+  { throw std::runtime_error(fmt::format("{}: {}", what, std::strerror(errno))); }
+
+  std::filesystem::path m_dir;
+
+  int m_segment_fd { -1 };
+  std::size_t m_segment { 0 };
+  std::size_t m_segment_size { 0 };
+
+  std::size_t m_unsynced { 0 };
+
+  std::vector<Location> m_locations;
+  std::vector<Digest> m_hashes;
+  std::unordered_map<Digest, uint64_t> m_heights;
+};
+
+} // end namespace bc
@@ -2,14 +2,20 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <shared_mutex>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -18,10 +24,157 @@
 #include "difficulty.h"
 #include "format.h"
 #include "json.h"
+#include "thread_pool.h"
 
 namespace bc
 {
 
+// Everything but a block's data, which is only represented by its hash. Since
+// the block hash covers the data hash, headers can be validated (including
+// their proof of work) before the data is known.
+template<typename HASHER = SHA256Hasher>
+class BlockHeader
+{
+public:
+  // Serialization format version of blocks and headers. Blocks without a
+  // version were hashed over their serialized data instead of its hash, their
+  // hashes can no longer be verified.
+  static constexpr uint64_t VERSION { 2 };
+
+  static void check_version(json const &j)
+  {
+    uint64_t version { j.contains("version") ? j["version"].get<uint64_t>() : 1 };
+
+    if (version != VERSION)
+      throw std::logic_error(
+        fmt::format("unsupported block format version {} (expected {}), "
+                    "blockchains created by older versions have to be recreated",
+                    version, VERSION));
+  }
+
+  BlockHeader(Digest data_hash,
+              clock::TimePoint timestamp,
+              std::size_t nonce,
+              uint64_t index,
+              Digest hash,
+              std::optional<Digest> hash_prev)
+  : m_data_hash(std::move(data_hash)),
+    m_timestamp(timestamp),
+    m_nonce(nonce),
+    m_index(index),
+    m_hash(std::move(hash)),
+    m_hash_prev(std::move(hash_prev))
+  {}
+
+  clock::TimePoint timestamp() const
+  { return m_timestamp; }
+
+  uint64_t index() const
+  { return m_index; }
+
+  Digest hash() const
+  { return m_hash; }
+
+  bool operator==(BlockHeader const &other) const = default;
+
+  std::pair<bool, std::string> valid() const
+  {
+    if (m_hash != determine_hash(m_data_hash, m_timestamp, m_nonce, m_index, m_hash_prev))
+        return { false, "invalid hash" };
+
+    if (m_timestamp - config().blockgen_time_max_delta >= clock::now())
+        return { false, "invalid timestamp" };
+
+    return { true, "" };
+  }
+
+  bool is_genesis() const
+  { return m_index == 0 && !m_hash_prev; }
+
+  // 'prev' can be a header or a full block.
+  template<typename PREV>
+  bool is_successor_of(PREV const &prev) const
+  {
+    return (m_timestamp > prev.timestamp() - config().blockgen_time_max_delta) &&
+           (m_index == prev.index() + 1) &&
+           (m_hash_prev && *m_hash_prev == prev.hash());
+  }
+
+  double max_difficulty() const
+  { return std::pow(2.0, m_hash.zero_prefix_length()); }
+
+  json to_json() const
+  {
+    json j;
+
+    j["version"] = VERSION;
+    j["data_hash"] = m_data_hash.to_string();
+    j["timestamp"] = clock::to_time_since_epoch(m_timestamp);
+    j["nonce"] = m_nonce;
+    j["index"] = m_index;
+
+    j["hash"] = m_hash.to_string();
+
+    if (m_hash_prev)
+      j["hash_prev"] = m_hash_prev->to_string();
+
+    return j;
+  }
+
+  static BlockHeader from_json(json const &j)
+  {
+    check_version(j);
+
+    auto data_hash { Digest::from_string(j["data_hash"].get<std::string>()) };
+    auto timestamp { clock::from_time_since_epoch(j["timestamp"].get<uint64_t>()) };
+    auto nonce { j["nonce"].get<std::size_t>() };
+    auto index { j["index"].get<uint64_t>() };
+
+    auto hash { Digest::from_string(j["hash"].get<std::string>()) };
+
+    std::optional<Digest> hash_prev;
+    if (j.count("hash_prev"))
+        hash_prev = Digest::from_string(j["hash_prev"].get<std::string>());
+
+    return BlockHeader {
+      std::move(data_hash),
+      timestamp,
+      nonce,
+      index,
+      std::move(hash),
+      std::move(hash_prev)
+    };
+  }
+
+  static Digest determine_hash(Digest const &data_hash,
+                               clock::TimePoint timestamp,
+                               std::size_t nonce,
+                               uint64_t index,
+                               std::optional<Digest> const &hash_prev)
+  {
+    std::stringstream ss;
+
+    ss << data_hash.to_string();
+    ss << clock::to_time_since_epoch(timestamp);
+    ss << nonce;
+    ss << index;
+
+    if (hash_prev)
+      ss << hash_prev->to_string();
+
+    return HASHER::instance().hash(ss.str());
+  }
+
+private:
+  Digest m_data_hash;
+  clock::TimePoint m_timestamp;
+  std::size_t m_nonce;
+  uint64_t m_index;
+
+  Digest m_hash;
+  std::optional<Digest> m_hash_prev;
+};
+
 template<typename T, typename HASHER = SHA256Hasher>
 class Block
 {
@@ -30,6 +183,7 @@ class Block
 
 public:
   using data_type = T;
+  using header_type = BlockHeader<HASHER>;
 
   explicit Block(T data)
   : m_data { std::move(data) },
@@ -63,19 +217,35 @@ public:
   Digest hash() const
   { return m_hash; }
 
+  header_type header() const
+  { return { data_hash(), m_timestamp, m_nonce, m_index, m_hash, m_hash_prev }; }
+
+  // The header is validated first since that is much cheaper than validating
+  // the block's data.
   std::pair<bool, std::string> valid() const
   {
+    auto [header_valid, header_error] = valid_header();
+
+    if (!header_valid)
+        return { false, header_error };
+
     auto [data_valid, data_error] = m_data.valid(m_index);
 
     if (!data_valid)
         return { false, fmt::format("invalid data: {}", data_error) };
 
-    if (m_timestamp - config().blockgen_time_max_delta >= clock::now())
-        return { false, "invalid timestamp" };
+    return { true, "" };
+  }
 
+  // Validate everything but the block's data.
+  std::pair<bool, std::string> valid_header() const
+  {
     if (m_hash != determine_hash())
         return { false, "invalid hash" };
 
+    if (m_timestamp - config().blockgen_time_max_delta >= clock::now())
+        return { false, "invalid timestamp" };
+
     return { true, "" };
   }
 
@@ -97,10 +267,13 @@ public:
   {
     auto difficulty_log2 { static_cast<std::size_t>(std::log2(difficulty)) };
 
+    // Only the header changes while mining.
+    auto data_hash { this->data_hash() };
+
     for (;;) {
       m_timestamp = clock::now();
 
-      auto maybe_hash { determine_hash() };
+      auto maybe_hash { determine_hash(data_hash) };
       if (maybe_hash.zero_prefix_length() >= difficulty_log2) {
         m_hash = maybe_hash;
         break;
@@ -115,6 +288,7 @@ public:
   {
     json j;
 
+    j["version"] = header_type::VERSION;
     j["data"] = m_data.to_json();
     j["timestamp"] = clock::to_time_since_epoch(m_timestamp);
     j["nonce"] = m_nonce;
@@ -130,6 +304,8 @@ public:
 
   static Block from_json(json const &j)
   {
+    header_type::check_version(j);
+
     auto data { T::from_json(j["data"]) };
     auto timestamp { clock::from_time_since_epoch(j["timestamp"].get<uint64_t>()) };
     auto nonce { j["nonce"].get<std::size_t>() };
@@ -166,20 +342,14 @@ private:
     m_hash_prev(std::move(hash_prev))
   {}
 
-  Digest determine_hash() const
-  {
-    std::stringstream ss;
+  Digest data_hash() const
+  { return HASHER::instance().hash(m_data.to_json().dump()); }
 
-    ss << m_data.to_json();
-    ss << clock::to_time_since_epoch(m_timestamp);
-    ss << m_nonce;
-    ss << m_index;
-
-    if (m_hash_prev)
-      ss << m_hash_prev->to_string();
+  Digest determine_hash() const
+  { return determine_hash(data_hash()); }
 
-    return HASHER::instance().hash(ss.str());
-  }
+  Digest determine_hash(Digest const &data_hash) const
+  { return header_type::determine_hash(data_hash, m_timestamp, m_nonce, m_index, m_hash_prev); }
 
   T m_data;
   clock::TimePoint m_timestamp;
@@ -193,33 +363,178 @@ private:
 template<typename T, typename HASHER = SHA256Hasher>
 class Blockchain
 {
+  // Blocks are serialized once when they are appended since they are not
+  // modified afterwards.
+  struct Entry
+  {
+    Block<T, HASHER> block;
+    std::string serialized;
+#ifdef PROOF_OF_WORK
+    // Difficulty adjustment state after this block, e.g. cumulative difficulty.
+    DifficultyAdjuster difficulty_adjuster;
+#endif // PROOF_OF_WORK
+  };
+
+  // Number of blocks per storage segment.
+  static constexpr std::size_t SEGMENT_SIZE = 256;
+
+  using Segment = std::array<std::optional<Entry>, SEGMENT_SIZE>;
+
 public:
   using value_type = Block<T, HASHER>;
-  using const_iterator = typename std::vector<value_type>::const_iterator;
+  using header_type = BlockHeader<HASHER>;
 
-  Blockchain() = default;
+  // Items contained in block data, e.g. transactions or text entries.
+  using item = typename T::value_type;
+
+  struct ItemRecord
+  {
+    item value;
+    uint64_t block_index;
+    std::size_t position;
+    uint64_t confirmations;
+  };
+
+  // Immutable view of the blockchain at some point in time. Blocks are stored
+  // in fixed size segments shared between snapshots, appending a block never
+  // moves existing blocks, so references into a snapshot remain valid for as
+  // long as the snapshot is held.
+  class Snapshot
+  {
+    friend class Blockchain;
+
+  public:
+    // Blocks with indices in [first, last), see Snapshot::slice.
+    class Slice
+    {
+    public:
+      Slice(Snapshot const &snapshot, uint64_t first, uint64_t last)
+      : m_snapshot { snapshot }
+      , m_first { first }
+      , m_last { last }
+      {}
+
+      bool empty() const
+      { return m_first == m_last; }
+
+      std::size_t size() const
+      { return m_last - m_first; }
+
+      value_type const &operator[](std::size_t i) const
+      { return m_snapshot[m_first + i]; }
+
+    private:
+      Snapshot const &m_snapshot;
+      uint64_t m_first;
+      uint64_t m_last;
+    };
+
+    bool empty() const
+    { return m_length == 0; }
+
+    std::size_t size() const
+    { return m_length; }
+
+    std::size_t length() const
+    { return m_length; }
+
+    value_type const &operator[](uint64_t index) const
+    { return entry(index).block; }
+
+    value_type const &block(uint64_t index) const
+    { return entry(index).block; }
+
+    value_type const &latest_block() const
+    { return entry(m_length - 1).block; }
+
+    std::string const &serialized(uint64_t index) const
+    { return entry(index).serialized; }
+
+    // Clamped to the snapshot's length.
+    Slice slice(uint64_t first, uint64_t last) const
+    {
+      last = std::min<uint64_t>(last, m_length);
+
+      return { *this, std::min(first, last), last };
+    }
 
-  Blockchain(Blockchain &&other)
-  : m_blocks { std::move(other.m_blocks) }
 #ifdef PROOF_OF_WORK
-  , m_difficulty_adjuster { std::move(other.m_difficulty_adjuster) }
+    // Difficulty adjustment state after appending the first 'length' blocks.
+    DifficultyAdjuster difficulty_adjuster(uint64_t length) const
+    {
+      if (length == 0)
+        return {};
+
+      return entry(length - 1).difficulty_adjuster;
+    }
 #endif // PROOF_OF_WORK
+
+  private:
+    Entry const &entry(uint64_t index) const
+    {
+      assert(index < m_length);
+
+      return *(*m_segments[index / SEGMENT_SIZE])[index % SEGMENT_SIZE];
+    }
+
+    // Slots past the length of the newest snapshot are not visible to any
+    // snapshot, so they can be written even if the segment is shared.
+    void push(Entry entry)
+    {
+      if (m_length == m_segments.size() * SEGMENT_SIZE)
+        m_segments.push_back(std::make_shared<Segment>());
+
+      (*m_segments[m_length / SEGMENT_SIZE])[m_length % SEGMENT_SIZE] = std::move(entry);
+
+      ++m_length;
+    }
+
+    // Older snapshots may still see the dropped blocks, so the segment that
+    // will be written next is copied instead of overwritten.
+    void truncate(uint64_t length)
+    {
+      if (length >= m_length)
+        return;
+
+      auto segment { length / SEGMENT_SIZE };
+      auto offset { length % SEGMENT_SIZE };
+
+      if (offset > 0) {
+        auto copy { std::make_shared<Segment>() };
+
+        std::copy_n(m_segments[segment]->begin(), offset, copy->begin());
+
+        m_segments[segment++] = std::move(copy);
+      }
+
+      m_segments.erase(m_segments.begin() + segment, m_segments.end());
+
+      m_length = length;
+    }
+
+    std::vector<std::shared_ptr<Segment>> m_segments;
+    uint64_t m_length { 0 };
+  };
+
+  Blockchain() = default;
+
+  Blockchain(Blockchain &&other)
+  : m_snapshot { other.m_snapshot.exchange(std::make_shared<Snapshot const>()) }
+  , m_block_index { std::move(other.m_block_index) }
+  , m_item_index { std::move(other.m_item_index) }
   {}
 
   void operator=(Blockchain &&other)
   {
-    std::scoped_lock lock { m_mtx, other.m_mtx };
+    std::scoped_lock lock { m_mtx, other.m_mtx, m_index_mtx, other.m_index_mtx };
 
-    m_blocks = std::move(other.m_blocks);
-#ifdef PROOF_OF_WORK
-    m_difficulty_adjuster = std::move(other.m_difficulty_adjuster);
-#endif // PROOF_OF_WORK
+    m_snapshot = other.m_snapshot.exchange(std::make_shared<Snapshot const>());
+    m_block_index = std::move(other.m_block_index);
+    m_item_index = std::move(other.m_item_index);
   }
 
   auto operator<=>(Blockchain const &other) const
   {
-    std::scoped_lock lock { m_mtx };
-
 #ifdef PROOF_OF_WORK
     return cumulative_difficulty() <=> other.cumulative_difficulty();
 #else
@@ -227,155 +542,636 @@ public:
 #endif // PROOF_OF_WORK
   }
 
-  bool empty() const
-  {
-    std::scoped_lock lock { m_mtx };
+  // The latest published state of the blockchain. Reading it never blocks and
+  // it is not affected by blocks appended or replaced afterwards.
+  std::shared_ptr<Snapshot const> snapshot() const
+  { return m_snapshot.load(); }
 
-    return m_blocks.empty();
-  }
+  bool empty() const
+  { return snapshot()->empty(); }
 
   std::size_t length() const
-  {
-    std::scoped_lock lock { m_mtx };
-
-    return m_blocks.size();
-  }
+  { return snapshot()->length(); }
 
+  // Block hashes don't depend on any other blocks and are verified in
+  // parallel, as are transaction signatures once the outputs they spend are
+  // known. Linkage, difficulty and data (e.g. unspent outputs) are checked in
+  // a sequential pass.
   std::pair<bool, std::string> valid() const
   {
-    std::scoped_lock lock { m_mtx };
+    auto snapshot { this->snapshot() };
+    auto const &blocks { *snapshot };
 
-    if (m_blocks.empty())
+    if (blocks.empty())
       return { false, "empty blockchain" };
 
-    for (std::size_t i { 0 }; i < m_blocks.size(); ++i) {
-      auto const &block { m_blocks[i] };
+    auto [headers_valid, headers_error] = valid_headers(blocks);
 
-      auto [block_valid, block_error] = block.valid();
+    if (!headers_valid)
+      return { false, headers_error };
 
-      if (!block_valid)
-        return { false, fmt::format("block {}: {}", i, block_error) };
-    }
-
-    if (!m_blocks[0].is_genesis())
+    if (!blocks[0].is_genesis())
       return { false, "invalid genesis block" };
 
-    for (uint64_t i = 1; i < m_blocks.size(); ++i) {
-      if (!m_blocks[i].is_successor_of(m_blocks[i - 1]))
+#ifdef PROOF_OF_WORK
+    DifficultyAdjuster difficulty_adjuster;
+#endif // PROOF_OF_WORK
+
+    typename T::chain_validator validator;
+
+    // The validator may modify the data it validates (e.g. link transactions
+    // with the outputs they spend), so it works on copies of the blocks which
+    // are kept for the final pass.
+    std::vector<value_type> validated;
+    validated.reserve(blocks.length());
+
+    for (uint64_t i = 0; i < blocks.length(); ++i) {
+      auto const &block { blocks[i] };
+
+      if (i > 0 && !block.is_successor_of(blocks[i - 1]))
         return { false, fmt::format("block {}: not a valid successor", i) };
+
+      if (!config().checkpoint_hash.empty() &&
+          i == config().checkpoint_height &&
+          block.hash() != Digest::from_string(config().checkpoint_hash)) {
+        return { false, fmt::format("block {}: conflicts with checkpoint", i) };
+      }
+
+#ifdef PROOF_OF_WORK
+      difficulty_adjuster.adjust(block.timestamp());
+
+      if (block.max_difficulty() < difficulty_adjuster.difficulty())
+        return { false, fmt::format("block {}: invalid difficulty", i) };
+#endif // PROOF_OF_WORK
+
+      auto &copy { validated.emplace_back(block) };
+
+      auto [data_valid, data_error] = validator(copy.data(), copy.index());
+
+      if (!data_valid)
+        return { false, fmt::format("block {}: invalid data: {}", i, data_error) };
     }
 
-    return { true, "" };
+    return validator.finish(validated);
   }
 
 #ifdef PROOF_OF_WORK
   std::size_t cumulative_difficulty() const
   {
-    std::scoped_lock lock { m_mtx };
+    auto snapshot { this->snapshot() };
 
-    return m_difficulty_adjuster.cumulative_difficulty();
+    return snapshot->difficulty_adjuster(snapshot->length()).cumulative_difficulty();
   }
 #endif // PROOF_OF_WORK
 
   std::vector<value_type> all_blocks() const
+  { return blocks(0, length()); }
+
+  // Returned by value, use a snapshot to avoid copying the block.
+  value_type latest_block() const
   {
-    std::scoped_lock lock { m_mtx };
+    auto snapshot { this->snapshot() };
+
+    assert(!snapshot->empty());
 
-    return m_blocks;
+    return snapshot->latest_block();
   }
 
-  value_type const &latest_block() const
+  value_type block(uint64_t index) const
+  { return snapshot()->block(index); }
+
+  // Blocks with indices in [first, last), clamped to the blockchain's length.
+  std::vector<value_type> blocks(uint64_t first, uint64_t last) const
   {
-    std::scoped_lock lock { m_mtx };
+    auto snapshot { this->snapshot() };
+    auto slice { snapshot->slice(first, last) };
+
+    std::vector<value_type> blocks;
+    blocks.reserve(slice.size());
 
-    assert(!m_blocks.empty());
+    for (std::size_t i { 0 }; i < slice.size(); ++i)
+      blocks.push_back(slice[i]);
 
-    return m_blocks.back();
+    return blocks;
   }
 
-  void construct_next_block(T data)
+  // Like blocks but returns a JSON array of the blocks' cached serializations,
+  // see json_raw.
+  json blocks_to_json(uint64_t first, uint64_t last) const
+  {
+    auto snapshot { this->snapshot() };
+
+    json j = json::array();
+
+    for (auto i { first }; i < std::min<uint64_t>(last, snapshot->length()); ++i)
+      j.push_back(json_raw(snapshot->serialized(i)));
+
+    return j;
+  }
+
+  // Cached serialization of the latest block, null if the blockchain is empty.
+  json latest_block_to_json() const
+  {
+    auto snapshot { this->snapshot() };
+
+    if (snapshot->empty())
+      return nullptr;
+
+    return json_raw(snapshot->serialized(snapshot->length() - 1));
+  }
+
+  // Cached serialization of the block with the given hash, null if there is
+  // no such block.
+  json block_to_json(Digest const &hash) const
+  {
+    std::shared_lock lock { m_index_mtx };
+
+    auto it { m_block_index.find(hash) };
+    if (it == m_block_index.end())
+      return nullptr;
+
+    return json_raw(snapshot()->serialized(it->second));
+  }
+
+  std::vector<header_type> headers(uint64_t first, uint64_t last) const
+  {
+    auto snapshot { this->snapshot() };
+
+    std::vector<header_type> headers;
+
+    for (auto i { first }; i < std::min<uint64_t>(last, snapshot->length()); ++i)
+      headers.push_back(snapshot->block(i).header());
+
+    return headers;
+  }
+
+  std::optional<uint64_t> find_block(Digest const &hash) const
+  {
+    std::shared_lock lock { m_index_mtx };
+
+    auto it { m_block_index.find(hash) };
+    if (it == m_block_index.end())
+      return std::nullopt;
+
+    return it->second;
+  }
+
+  // Whether this exact block is already part of the chain.
+  bool contains(value_type const &block) const
+  { return contains(block.index(), block.hash()); }
+
+  bool contains(uint64_t index, Digest const &hash) const
+  {
+    auto snapshot { this->snapshot() };
+
+    return index < snapshot->length() && snapshot->block(index).hash() == hash;
+  }
+
+  std::optional<ItemRecord> find_item(Digest const &hash) const
+  {
+    std::shared_lock lock { m_index_mtx };
+
+    auto it { m_item_index.find(hash) };
+    if (it == m_item_index.end())
+      return std::nullopt;
+
+    auto [block_index, position] = it->second;
+
+    auto snapshot { this->snapshot() };
+
+    return ItemRecord { snapshot->block(block_index).data().get()[position],
+                        block_index,
+                        position,
+                        snapshot->length() - block_index };
+  }
+
+  // Data that has already been validated (e.g. assembled from validated
+  // transactions ahead of time) is not validated again.
+  void construct_next_block(T data, bool data_validated = false)
   {
     std::scoped_lock lock { m_mtx };
 
+    auto next { *snapshot() };
+
     std::unique_ptr<value_type> block;
 
-    if (m_blocks.empty())
+    if (next.empty())
       block = std::make_unique<value_type>(std::move(data));
     else
-      block = std::make_unique<value_type>(std::move(data), latest_block());
+      block = std::make_unique<value_type>(std::move(data), next.latest_block());
 
-    auto [block_valid, block_error] = block->valid();
+    auto [block_valid, block_error] = data_validated ? block->valid_header() : block->valid();
 
     if (!block_valid)
       throw std::logic_error(fmt::format("attempted appending invalid data: {}", block_error));
 
 #ifdef PROOF_OF_WORK
-    m_difficulty_adjuster.adjust(block->timestamp());
+    auto difficulty_adjuster { next.difficulty_adjuster(next.length()) };
 
-    block->adjust_difficulty(m_difficulty_adjuster.difficulty());
+    difficulty_adjuster.adjust(block->timestamp());
+
+    block->adjust_difficulty(difficulty_adjuster.difficulty());
+
+    push_block(next, std::move(*block), difficulty_adjuster);
+#else
+    push_block(next, std::move(*block));
 #endif // PROOF_OF_WORK
 
-    m_blocks.emplace_back(std::move(*block));
+    auto fork { next.length() - 1 };
+
+    publish(std::move(next), fork);
   }
 
   void append_next_block(value_type block)
+  {
+    append_next_block(std::move(block), [](T const &data, uint64_t index)
+                                        { return data.valid(index); });
+  }
+
+  // Blocks are validated in order of increasing cost, each check is performed
+  // exactly once: index and linkage, hash and timestamp, checkpoint, proof of
+  // work and finally the block's data via 'valid_data', which may modify the data
+  // (e.g. link transactions with the outputs they spend) before validating it.
+  template<typename FUNC>
+  void append_next_block(value_type block, FUNC &&valid_data)
+  {
+    std::scoped_lock lock { m_mtx };
+
+    auto next { *snapshot() };
+
+    append(next, std::move(block), valid_data, true);
+
+    auto fork { next.length() - 1 };
+
+    publish(std::move(next), fork);
+  }
+
+  // Whether replacing all blocks from index 'fork' onwards with 'blocks', which
+  // may also be headers, would result in a preferable blockchain, see
+  // operator<=>. The blocks are not validated.
+  template<typename BLOCKS>
+  bool preferable(uint64_t fork, BLOCKS const &blocks) const
+  {
+    auto snapshot { this->snapshot() };
+
+    if (fork > snapshot->length())
+      return false;
+
+#ifdef PROOF_OF_WORK
+    auto difficulty_adjuster { snapshot->difficulty_adjuster(fork) };
+
+    for (auto const &block : blocks)
+      difficulty_adjuster.adjust(block.timestamp());
+
+    return difficulty_adjuster.cumulative_difficulty() >
+           snapshot->difficulty_adjuster(snapshot->length()).cumulative_difficulty();
+#else
+    return fork + blocks.size() > snapshot->length();
+#endif // PROOF_OF_WORK
+  }
+
+  // Validates headers of blocks that would replace all blocks from index 'fork'
+  // onwards: hashes, linkage, checkpoint and proof of work. Hashes are
+  // verified in parallel. Headers before 'first' have already been validated
+  // by a previous call, e.g. when headers arrive in chunks.
+  std::pair<bool, std::string> valid_header_chain(
+    uint64_t fork,
+    std::span<header_type const> headers,
+    std::size_t first = 0) const
+  {
+    auto snapshot { this->snapshot() };
+
+    if (fork > snapshot->length())
+      return { false, "headers not connected to blockchain" };
+
+    std::vector<std::pair<bool, std::string>> results(headers.size() - first);
+
+    ThreadPool::instance().parallel_for(results.size(), [&](std::size_t i){
+      results[i] = headers[first + i].valid();
+    });
+
+#ifdef PROOF_OF_WORK
+    auto difficulty_adjuster { snapshot->difficulty_adjuster(fork) };
+
+    for (std::size_t i { 0 }; i < first; ++i)
+      difficulty_adjuster.adjust(headers[i].timestamp());
+#endif // PROOF_OF_WORK
+
+    for (std::size_t i { first }; i < headers.size(); ++i) {
+      auto const &header { headers[i] };
+
+      if (!results[i - first].first)
+        return { false, fmt::format("block {}: {}", fork + i, results[i - first].second) };
+
+      bool linked;
+      if (i > 0)
+        linked = header.is_successor_of(headers[i - 1]);
+      else if (fork > 0)
+        linked = header.is_successor_of(snapshot->block(fork - 1));
+      else
+        linked = header.is_genesis();
+
+      if (!linked)
+        return { false, fmt::format("block {}: not a valid successor", fork + i) };
+
+      if (!config().checkpoint_hash.empty() &&
+          header.index() == config().checkpoint_height &&
+          header.hash() != Digest::from_string(config().checkpoint_hash)) {
+        return { false, fmt::format("block {}: conflicts with checkpoint", fork + i) };
+      }
+
+#ifdef PROOF_OF_WORK
+      difficulty_adjuster.adjust(header.timestamp());
+
+      if (header.max_difficulty() < difficulty_adjuster.difficulty())
+        return { false, fmt::format("block {}: invalid difficulty", fork + i) };
+#endif // PROOF_OF_WORK
+    }
+
+    return { true, "" };
+  }
+
+  // Replaces all blocks from index 'fork' onwards with 'blocks' if the result
+  // is preferable to this blockchain, see operator<=>. Leading blocks that are
+  // already part of this blockchain are skipped and only the blocks after the
+  // point where both chains actually diverge are validated, the common prefix
+  // has already been validated. Returns whether any blocks were replaced and
+  // throws if the new blocks are invalid, leaving the blockchain unchanged.
+  // Readers keep seeing the current blocks until all new blocks are valid.
+  bool replace_suffix(uint64_t fork, std::vector<value_type> blocks)
+  {
+    auto make_validator = [](Snapshot const &prefix, uint64_t fork_){
+      typename T::chain_validator validator;
+
+      for (uint64_t i { 0 }; i < fork_; ++i)
+        validator.skip(prefix[i].data());
+
+      return validator;
+    };
+
+    return replace_suffix(fork, std::move(blocks), make_validator);
+  }
+
+  // As above, but the chain validator for the blocks after the common prefix
+  // is returned by make_validator(blocks, fork), e.g. to start from state kept
+  // by the caller instead of going over all blocks before the fork again.
+  template<typename MAKE_VALIDATOR>
+  bool replace_suffix(uint64_t fork,
+                      std::vector<value_type> blocks,
+                      MAKE_VALIDATOR &&make_validator)
   {
     std::scoped_lock lock { m_mtx };
 
-    if (m_blocks.empty()) {
-      auto [valid, error] = valid_genesis_block(block);
+    auto next { *snapshot() };
+
+    if (fork > next.length())
+      throw std::logic_error("attempted replacing blocks beyond the end of the blockchain");
+
+    auto first { blocks.begin() };
+
+    while (first != blocks.end() && contains(*first)) {
+      ++first;
+      ++fork;
+    }
+
+    blocks.erase(blocks.begin(), first);
+
+    if (blocks.empty())
+      return false;
+
+    // Compare the chains before validating anything.
+    if (!preferable(fork, blocks))
+      return false;
+
+    // Check the hashes before looking at any of the blocks' data.
+    auto [headers_valid, headers_error] = valid_headers(blocks);
+
+    if (!headers_valid)
+      throw std::logic_error(
+        fmt::format("attempted replacing blocks with invalid blocks: {}", headers_error));
+
+    auto validator { make_validator(std::as_const(next), fork) };
+
+    next.truncate(fork);
+
+    try {
+      for (auto &block : blocks)
+        append(next, std::move(block), validator, false);
+
+      auto [valid, error] = validator.finish(next.slice(fork, next.length()));
+
+      if (!valid)
+        throw std::logic_error(error);
+
+    } catch (std::exception const &e) {
+      throw std::logic_error(
+        fmt::format("attempted replacing blocks with invalid blocks: {}", e.what()));
+    }
+
+    publish(std::move(next), fork);
+
+    return true;
+  }
+
+  json to_json() const
+  {
+    auto snapshot { this->snapshot() };
+
+    json j = json::array();
+
+    for (uint64_t i = 0; i < snapshot->length(); ++i)
+      j.push_back(snapshot->block(i).to_json());
+
+    return j;
+  }
+
+  // Builds a blockchain from blocks passed in order to the function handed to
+  // 'produce'. The blocks' data is validated across the whole chain, e.g. by
+  // keeping track of unspent transaction outputs.
+  template<typename FUNC>
+  static Blockchain load(FUNC &&produce)
+  {
+    Snapshot blocks;
+
+    typename T::chain_validator validator;
+
+    // Block hashes and, depending on the validator, parts of the blocks' data
+    // (e.g. transaction signatures) are verified in parallel once all blocks
+    // have been appended.
+    produce([&blocks, &validator](value_type block)
+            { append(blocks, std::move(block), validator, false); });
+
+    auto [headers_valid, headers_error] = valid_headers(blocks);
+
+    if (!headers_valid)
+      throw std::logic_error(fmt::format("attempted loading invalid blockchain: {}", headers_error));
+
+    auto [valid, error] = validator.finish(blocks);
+
+    if (!valid)
+      throw std::logic_error(fmt::format("attempted loading invalid blockchain: {}", error));
+
+    Blockchain bchain;
+
+    bchain.publish(std::move(blocks), 0);
+
+    return std::move(bchain);
+  }
+
+  static Blockchain from_json(json const &j)
+  {
+    return load([&j](auto &&append){
+      for (auto const &j_block : j)
+        append(value_type::from_json(j_block));
+    });
+  }
+
+  // Like from_json but appends blocks while parsing, so that only a single
+  // block's JSON representation is held in memory at any time.
+  template<typename IT>
+  static Blockchain parse(IT first, IT last)
+  {
+    return load([first, last](auto &&append){
+      auto callback = [&append](int depth, json::parse_event_t event, json &parsed){
+        if (depth != 1 || event != json::parse_event_t::object_end)
+          return true;
+
+        append(value_type::from_json(parsed));
+
+        // Discard the block's JSON representation.
+        return false;
+      };
+
+      // The callback has already consumed every block, so the returned
+      // (empty) array is of no use.
+      [[maybe_unused]] auto const discarded = json::parse(first, last, callback);
+    });
+  }
+
+private:
+  // Appends to 'blocks', which is not yet visible to readers. Verifying the
+  // block's hash can be deferred when appending many blocks at once, see load.
+  template<typename FUNC>
+  static void append(Snapshot &blocks, value_type block, FUNC &&valid_data, bool verify_hash)
+  {
+    if (blocks.empty()) {
+      auto [valid, error] = valid_genesis_block(block, verify_hash);
 
       if (!valid)
         throw std::logic_error(
           fmt::format("attempted appending invalid genesis block: {}", error));
 
     } else {
-      auto [valid, error] = valid_next_block(block, latest_block());
+      auto [valid, error] = valid_next_block(block, blocks.latest_block(), verify_hash);
 
       if (!valid)
         throw std::logic_error(
           fmt::format("attempted appending invalid next block: {}", error));
     }
 
+    if (!config().checkpoint_hash.empty() &&
+        block.index() == config().checkpoint_height &&
+        block.hash() != Digest::from_string(config().checkpoint_hash)) {
+      throw std::logic_error("attempted appending block conflicting with checkpoint");
+    }
+
 #ifdef PROOF_OF_WORK
-    m_difficulty_adjuster.adjust(block.timestamp());
+    // Only commit the adjustment once the block is known to be valid.
+    auto difficulty_adjuster { blocks.difficulty_adjuster(blocks.length()) };
+
+    difficulty_adjuster.adjust(block.timestamp());
 
-    if (block.max_difficulty() < m_difficulty_adjuster.difficulty())
+    if (block.max_difficulty() < difficulty_adjuster.difficulty())
       throw std::logic_error("attempted appending a block with invalid difficulty");
 #endif // PROOF_OF_WORK
 
-    m_blocks.emplace_back(std::move(block));
+    auto [data_valid, data_error] = valid_data(block.data(), block.index());
+
+    if (!data_valid)
+      throw std::logic_error(
+        fmt::format("attempted appending block with invalid data: {}", data_error));
+
+#ifdef PROOF_OF_WORK
+    push_block(blocks, std::move(block), difficulty_adjuster);
+#else
+    push_block(blocks, std::move(block));
+#endif // PROOF_OF_WORK
   }
 
-  json to_json() const
+#ifdef PROOF_OF_WORK
+  static void push_block(Snapshot &blocks,
+                         value_type block,
+                         DifficultyAdjuster const &difficulty_adjuster)
   {
-    std::scoped_lock lock { m_mtx };
-
-    json j = json::array();
+    auto serialized { block.to_json().dump() };
 
-    for (uint64_t i = 0; i < m_blocks.size(); ++i)
-      j.push_back(m_blocks[i].to_json());
+    blocks.push({ std::move(block), std::move(serialized), difficulty_adjuster });
+  }
+#else
+  static void push_block(Snapshot &blocks, value_type block)
+  {
+    auto serialized { block.to_json().dump() };
 
-    return j;
+    blocks.push({ std::move(block), std::move(serialized) });
   }
+#endif // PROOF_OF_WORK
 
-  static Blockchain from_json(json const &j)
+  // Makes 'next', which differs from the current snapshot in the blocks from
+  // index 'fork' onwards, visible to readers and updates the indices.
+  void publish(Snapshot next, uint64_t fork)
   {
-    Blockchain bchain;
+    std::scoped_lock lock { m_index_mtx };
 
-    for (auto const &j_block : j)
-      bchain.append_next_block(value_type::from_json(j_block));
+    auto prev { snapshot() };
 
-    return std::move(bchain);
+    for (uint64_t i { fork }; i < prev->length(); ++i) {
+      auto const &block { prev->block(i) };
+
+      m_block_index.erase(block.hash());
+
+      for (auto const &hash : block.data().hashes()) {
+        auto it { m_item_index.find(hash) };
+        if (it != m_item_index.end() && it->second.first >= fork)
+          m_item_index.erase(it);
+      }
+    }
+
+    for (uint64_t i { fork }; i < next.length(); ++i) {
+      auto const &block { next.block(i) };
+
+      m_block_index[block.hash()] = block.index();
+
+      auto hashes { block.data().hashes() };
+
+      for (std::size_t j { 0 }; j < hashes.size(); ++j)
+        m_item_index[hashes[j]] = { block.index(), j };
+    }
+
+    m_snapshot.store(std::make_shared<Snapshot const>(std::move(next)));
   }
 
-private:
-  explicit Blockchain(std::vector<value_type> const &blocks)
-  : m_blocks(blocks)
-  {}
+  template<typename BLOCKS>
+  static std::pair<bool, std::string> valid_headers(BLOCKS const &blocks)
+  {
+    std::vector<std::pair<bool, std::string>> results(blocks.size());
+
+    ThreadPool::instance().parallel_for(blocks.size(), [&](std::size_t i){
+      results[i] = blocks[i].valid_header();
+    });
+
+    for (std::size_t i { 0 }; i < results.size(); ++i) {
+      auto const &[valid, error] = results[i];
+
+      if (!valid)
+        return { false, fmt::format("block {}: {}", blocks[i].index(), error) };
+    }
+
+    return { true, "" };
+  }
 
   static std::pair<bool, std::string> valid_genesis_block(
-    value_type const &block)
+    value_type const &block,
+    bool verify_hash)
   {
     if (block.index() != 0)
       return { false, "invalid index" };
@@ -383,17 +1179,16 @@ private:
     if (block.m_hash_prev)
       return { false, "last hash not empty" };
 
-    auto [block_valid, block_error] = block.valid();
+    if (!verify_hash)
+      return { true, "" };
 
-    if (!block_valid)
-      return { false, block_error };
-
-    return { true, "" };
+    return block.valid_header();
   }
 
   static std::pair<bool, std::string> valid_next_block(
     value_type const &block,
-    value_type const &block_prev)
+    value_type const &block_prev,
+    bool verify_hash)
   {
     if (block.index() != block_prev.index() + 1)
       return { false, "invalid index" };
@@ -401,21 +1196,29 @@ private:
     if (!block.m_hash_prev || (*block.m_hash_prev != block_prev.m_hash))
       return { false, "mismatched hashes" };
 
-    auto [block_valid, block_error] = block.valid();
+    if (block.m_timestamp <= block_prev.m_timestamp - config().blockgen_time_max_delta)
+      return { false, "invalid timestamp" };
 
-    if (!block_valid)
-      return { false, block_error };
+    if (!verify_hash)
+      return { true, "" };
 
-    return { true, "" };
+    return block.valid_header();
   }
 
-  std::vector<value_type> m_blocks;
+  // Readers only ever load this, writers (serialized by 'm_mtx') prepare a new
+  // snapshot on the side and swap it in once it is complete.
+  std::atomic<std::shared_ptr<Snapshot const>> m_snapshot { std::make_shared<Snapshot const>() };
 
-#ifdef PROOF_OF_WORK
-  DifficultyAdjuster m_difficulty_adjuster;
-#endif // PROOF_OF_WORK
+  // Maps block hashes to block index.
+  std::unordered_map<Digest, uint64_t> m_block_index;
+
+  // Maps item hashes to block index and position within that block.
+  std::unordered_map<Digest, std::pair<uint64_t, std::size_t>> m_item_index;
+
+  // Guards the indices, which are updated together with 'm_snapshot'.
+  mutable std::shared_mutex m_index_mtx;
 
-  mutable std::recursive_mutex m_mtx;
+  std::mutex m_mtx;
 };
 
 } // end namespace bc
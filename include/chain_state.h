@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "crypto/keypair.h"
+#include "json.h"
+#include "transaction.h"
+
+namespace bc
+{
+
+// Unspent transaction outputs and unconfirmed transaction pool, safe to use
+// from multiple threads. Transaction admissions and unspent output lookups
+// only share the unspent outputs and hold the pool lock briefly, connecting
+// transactions to the chain requires exclusive access.
+template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
+class ChainState
+{
+  using transaction = Transaction<KEY_PAIR, HASHER>;
+  using transaction_list = TransactionList<KEY_PAIR, HASHER>;
+  using address_index = TransactionAddressIndex<KEY_PAIR, HASHER>;
+  using unspent_outputs = TransactionUnspentOutputs<KEY_PAIR, HASHER>;
+  using spent_outputs = typename unspent_outputs::spent_outputs;
+
+public:
+  // Chain validator for blocks replacing those from index 'fork' onwards,
+  // starting from the unspent outputs as they were before that block. Keeps
+  // the chain state locked against connecting and disconnecting while alive.
+  class Validator
+  {
+  public:
+    Validator(ChainState const &chain_state, std::size_t fork);
+
+    Validator(Validator const &) = delete;
+    Validator &operator=(Validator const &) = delete;
+
+    std::pair<bool, std::string> operator()(transaction_list &ts, uint64_t index)
+    { return m_validator(ts, index); }
+
+    void skip(transaction_list const &ts)
+    { m_validator.skip(ts); }
+
+    template<typename BLOCKS>
+    std::pair<bool, std::string> finish(BLOCKS const &blocks) const
+    { return m_validator.finish(blocks); }
+
+  private:
+    std::shared_lock<std::shared_mutex> m_lock;
+    unspent_outputs m_unspent_outputs;
+    TransactionChainValidator<KEY_PAIR, HASHER> m_validator { m_unspent_outputs };
+  };
+
+  void link(transaction &t) const;
+  void link(transaction_list &ts) const;
+
+  void add(transaction t);
+
+  std::vector<transaction> select(std::size_t n, std::size_t index);
+
+  std::optional<transaction> find_unconfirmed(Digest const &hash) const;
+
+  // Connects the transactions of the block with the given index. Pooled
+  // transactions for that or an earlier block are evicted.
+  void connect(transaction_list const &ts, std::size_t index);
+
+  // Undoes connect for all blocks from index 'fork' onwards. The unconfirmed
+  // pool is cleared since its transactions may depend on disconnected ones.
+  void disconnect(std::size_t fork);
+
+  // Confirmed transactions touching an address, only tracked if enabled via
+  // the transaction_address_index configuration option.
+  std::vector<typename address_index::Entry> address_transactions(
+    std::string const &address, std::size_t cursor, std::size_t limit) const;
+
+  void clear();
+
+  json unspent_outputs_to_json() const;
+  json unconfirmed_pool_to_json() const;
+
+private:
+  std::list<typename transaction::unspent_output> resolve(transaction const &t) const;
+
+  // Transactions of a connected block and the outputs each of them spent.
+  struct BlockUndo
+  {
+    transaction_list ts;
+    std::vector<spent_outputs> spent;
+  };
+
+  unspent_outputs m_unspent_outputs;
+  mutable std::shared_mutex m_unspent_outputs_mtx;
+
+  // Updated alongside the unspent outputs and guarded by the same mutex.
+  address_index m_address_index;
+  std::vector<BlockUndo> m_undo; // Indexed by block.
+
+  TransactionUnconfirmedPool<KEY_PAIR, HASHER> m_unconfirmed_pool;
+  mutable std::mutex m_unconfirmed_pool_mtx;
+};
+
+} // end namespace bc
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #include "clock.h"
@@ -7,6 +9,12 @@
 namespace bc
 {
 
+enum class PoolEviction
+{
+  REJECT, // Reject new transactions while the pool is full.
+  OLDEST  // Evict the oldest pooled transactions to make room.
+};
+
 struct Config
 {
   // Interval after which a new block should be mined.
@@ -24,6 +32,48 @@ struct Config
   std::size_t transaction_num_per_block { 10 };
   // Number of coins sent by reward transaction.
   std::size_t transaction_reward_amount { 50 };
+  // Maximum number of bytes occupied by the unconfirmed transaction pool.
+  std::size_t transaction_pool_size_max { 64 * 1024 * 1024 };
+  // Age after which unconfirmed transactions are dropped from the pool.
+  clock::TimeInterval transaction_pool_expiry { 3600000 };
+  // What to do when adding a transaction to a full pool.
+  PoolEviction transaction_pool_eviction { PoolEviction::OLDEST };
+  // Whether to index confirmed transactions by the addresses they touch.
+  bool transaction_address_index { false };
+
+  // Whether to produce blocks automatically from the unconfirmed transaction pool.
+  bool producer_enabled { false };
+  // Number of unconfirmed transactions after which a block is produced.
+  std::size_t producer_fill_threshold { 10 };
+  // Longest time a transaction waits in the pool before a block is produced.
+  clock::TimeInterval producer_latency_max { 10000 };
+  // Address to which the rewards for produced blocks are sent.
+  std::string producer_reward_address;
+
+  // Number of text entries per produced block, at most Text::ENTRIES_MAX.
+  std::size_t text_batch_size { 100 };
+  // Longest time a text entry is buffered before a block is produced.
+  clock::TimeInterval text_batch_latency_max { 1000 };
+
+  // Largest size of a single block store segment file in bytes.
+  std::size_t store_segment_size_max { 128 * 1024 * 1024 };
+  // Number of blocks appended to the block store between two fsyncs.
+  std::size_t store_sync_after { 16 };
+
+  // Height and hash of a block assumed to be valid. Signatures in blocks below
+  // it are not verified when validating a chain containing it.
+  uint64_t checkpoint_height { 0 };
+  std::string checkpoint_hash;
+
+  // Largest number of block headers sent in response to a single request.
+  std::size_t sync_headers_max { 2000 };
+  // Largest number of block headers requested from a peer before downloading
+  // the corresponding blocks, the remaining ones are requested afterwards.
+  std::size_t sync_headers_total_max { 100000 };
+  // Number of blocks downloaded from a peer in one request during sync.
+  std::size_t sync_window_size { 64 };
+  // Time after which a peer that has not answered a sync request is dropped.
+  clock::TimeInterval sync_timeout { 10000 };
 
   static Config from_defaults() { return Config {}; }
   static Config from_toml(std::string const &filename);
@@ -7,7 +7,11 @@
 #include <iomanip>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
+
+#include <boost/container/small_vector.hpp>
 
 namespace bc
 {
@@ -15,10 +19,18 @@ namespace bc
 class Digest
 {
 public:
+  // Digests up to this length (e.g. SHA256 hashes) are stored inline, longer
+  // ones (e.g. signatures) are stored on the heap.
+  static constexpr std::size_t INLINE_LENGTH = 32;
+
   Digest() = default;
 
-  Digest(std::vector<uint8_t> vec)
-  : m_vec { std::move(vec) }
+  Digest(uint8_t const *data, std::size_t length)
+  : m_vec(data, data + length)
+  {}
+
+  Digest(std::vector<uint8_t> const &vec)
+  : Digest(vec.data(), vec.size())
   {}
 
   bool operator==(Digest const &other) const
@@ -79,17 +91,18 @@ public:
       throw std::invalid_argument("invalid digest string");
     };
 
-    std::vector<uint8_t> vec;
-    for (std::size_t i = 0; i < str.length() / 2; ++i)
-      vec.push_back((char_to_nibble(str[2 * i]) << 4) | char_to_nibble(str[2 * i + 1]));
+    Digest d;
+
+    d.m_vec.reserve(str.length() / 2);
 
-    Digest d { vec };
+    for (std::size_t i = 0; i < str.length() / 2; ++i)
+      d.m_vec.push_back((char_to_nibble(str[2 * i]) << 4) | char_to_nibble(str[2 * i + 1]));
 
     return d;
   }
 
 private:
-  std::vector<uint8_t> m_vec;
+  boost::container::small_vector<uint8_t, INLINE_LENGTH> m_vec;
 };
 
 } // end namespace bc
@@ -102,7 +115,10 @@ struct hash<bc::Digest>
 {
   std::size_t operator()(bc::Digest const &d) const
   {
-    return hash<std::string>()(d.to_string());
+    std::string_view bytes {
+      reinterpret_cast<char const *>(d.data()), d.length() };
+
+    return hash<std::string_view>()(bytes);
   }
 };
 
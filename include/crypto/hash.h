@@ -45,7 +45,7 @@ public:
 
     EVP_MD_CTX_free(mdctx);
 
-    return Digest { std::vector<uint8_t> { d_data, d_data + d_length } };
+    return Digest { d_data, d_length };
 
   error:
     if (mdctx)
@@ -82,7 +82,7 @@ public:
     EVP_PKEY_CTX_free(pkey_ctx);
     EVP_PKEY_free(pkey);
 
-    return Digest { std::vector<uint8_t> { sig_data, sig_data + sig_length } };
+    return Digest { sig_data, sig_length };
 
   error:
     std::string error { ERR_error_string(ERR_get_error(), nullptr) };
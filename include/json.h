@@ -2,6 +2,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 #include <nlohmann/json.hpp>
 
@@ -22,3 +23,51 @@ inline json::const_reference json_get(json const &j, std::string const &key)
 
   return j[key];
 }
+
+// Embeds already serialized JSON (e.g. cached) in a JSON value without parsing
+// it again. Must be serialized with json_dump.
+inline json json_raw(std::string_view serialized)
+{ return json::binary(json::binary_t::container_type(serialized.begin(), serialized.end())); }
+
+inline void json_dump(json const &j, std::string &out)
+{
+  switch (j.type()) {
+  case json::value_t::binary:
+    out.append(j.get_binary().begin(), j.get_binary().end());
+    break;
+  case json::value_t::object:
+    out.push_back('{');
+    for (auto it { j.begin() }; it != j.end(); ++it) {
+      if (it != j.begin())
+        out.push_back(',');
+
+      out.append(json(it.key()).dump());
+      out.push_back(':');
+      json_dump(it.value(), out);
+    }
+    out.push_back('}');
+    break;
+  case json::value_t::array:
+    out.push_back('[');
+    for (auto it { j.begin() }; it != j.end(); ++it) {
+      if (it != j.begin())
+        out.push_back(',');
+
+      json_dump(*it, out);
+    }
+    out.push_back(']');
+    break;
+  default:
+    out.append(j.dump());
+    break;
+  }
+}
+
+// Like json::dump but writes values created by json_raw verbatim.
+inline std::string json_dump(json const &j)
+{
+  std::string out;
+  json_dump(j, out);
+
+  return out;
+}
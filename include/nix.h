@@ -1,13 +1,22 @@
 #pragma once
 
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <stdexcept>
+#include <string>
 
+#include <fcntl.h>
 #include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace bc::nix
 {
 
-void on_termination(void (*func)(int))
+inline void on_termination(void (*func)(int))
 {
   struct sigaction sa;
   std::memset(&sa, 0, sizeof(sa));
@@ -16,4 +25,64 @@ void on_termination(void (*func)(int))
   sigaction(SIGTERM, &sa, nullptr);
 }
 
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+  explicit MappedFile(std::string const &path)
+  {
+    int fd { ::open(path.c_str(), O_RDONLY) };
+    if (fd == -1)
+      throw std::runtime_error("failed to open '" + path + "': " + std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat '" + path + "': " + std::strerror(errno));
+    }
+
+    m_size = static_cast<std::size_t>(st.st_size);
+
+    if (m_size > 0) {
+      void *addr { ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) };
+
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("failed to map '" + path + "': " + std::strerror(errno));
+      }
+
+      ::madvise(addr, m_size, MADV_SEQUENTIAL);
+
+      m_data = static_cast<uint8_t const *>(addr);
+    }
+
+    ::close(fd);
+  }
+
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+
+  ~MappedFile()
+  {
+    if (m_data)
+      ::munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+
+  uint8_t const *data() const
+  { return m_data; }
+
+  std::size_t size() const
+  { return m_size; }
+
+  uint8_t const *begin() const
+  { return m_data; }
+
+  uint8_t const *end() const
+  { return m_data + m_size; }
+
+private:
+  uint8_t const *m_data { nullptr };
+  std::size_t m_size { 0 };
+};
+
 } // end namespace bc::nix
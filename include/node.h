@@ -1,11 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
+#include "block_store.h"
 #include "blockchain.h"
+#include "chain_state.h"
+#include "clock.h"
+#include "crypto/digest.h"
 #include "json.h"
 #include "log.h"
 #include "text.h"
@@ -32,49 +44,92 @@ public:
   using blockchain = Blockchain<Text>;
 #endif // TRANSACTION
 
+  using block_header = blockchain::header_type;
+  using block_store = BlockStore<block>;
+
   Node(std::string const &name,
        std::string const &websocket_addr,
        uint16_t websocket_port,
        std::string const &http_addr,
        uint16_t http_port,
-       blockchain bc);
+       blockchain bc,
+       std::unique_ptr<block_store> store = nullptr);
 
-  void run() const;
-  void stop() const;
+  void run();
+  void stop();
 
 private:
   void websocket_setup();
   void http_setup();
-  void blockchain_setup();
+  // Connects the blocks from index 'fork' onwards to the chain state, after
+  // disconnecting those previously connected there.
+  void blockchain_setup(uint64_t fork = 0);
+  void block_store_setup(uint64_t first = 0);
 
-  std::pair<HTTPServer::status, json> handle_blocks_get() const;
+  std::pair<HTTPServer::status, json> handle_blocks_get(json const &data) const;
   std::pair<HTTPServer::status, json> handle_blocks_latest_get() const;
+  std::pair<HTTPServer::status, json> handle_blocks_index_get(json const &data) const;
+  std::pair<HTTPServer::status, json> handle_blocks_hash_get(json const &data) const;
   std::pair<HTTPServer::status, json> handle_blocks_post(json const &data);
   std::pair<HTTPServer::status, json> handle_blocks_persist_post(json const &data) const;
   std::pair<HTTPServer::status, json> handle_peers_get() const;
   std::pair<HTTPServer::status, json> handle_peers_post(json const &data);
 #ifdef TRANSACTIONS
+  std::pair<HTTPServer::status, json> handle_transactions_get(json const &data) const;
   std::pair<HTTPServer::status, json> handle_transactions_latest_get();
   std::pair<HTTPServer::status, json> handle_transactions_post(json const &data);
+  std::pair<HTTPServer::status, json> handle_transactions_batch_post(json const &data);
   std::pair<HTTPServer::status, json> handle_transactions_unconfirmed_get();
   std::pair<HTTPServer::status, json> handle_transactions_unspent_get() const;
+  std::pair<HTTPServer::status, json> handle_addresses_transactions_get(json const &data) const;
+#else
+  std::pair<HTTPServer::status, json> handle_entries_get(json const &data) const;
+  std::pair<HTTPServer::status, json> handle_entries_post(json const &data);
 #endif // TRANSACTIONS
 
   json handle_request_latest_block(json const &data) const;
   json handle_request_all_blocks(json const &data) const;
+  json handle_request_headers(json const &data) const;
+  json handle_request_blocks_range(json const &data) const;
   json handle_receive_latest_block(json const &data);
   json handle_receive_all_blocks(json const &data);
 #ifdef TRANSACTIONS
   json handle_receive_transaction(json const &data);
+  json handle_receive_transactions(json const &data);
 #endif // TRANSACTIONS
 
   void broadcast_latest_block();
   void request_latest_block(std::size_t peer_id);
-  void request_all_blocks(std::size_t peer_id);
+
+  void sync(std::size_t peer_id);
+  bool sync_round(std::size_t peer_id);
+  std::optional<std::vector<block>> sync_blocks(std::vector<block_header> const &headers);
+  std::optional<json> sync_request(std::size_t peer_id, json request);
+
+  json block_locator() const;
+  uint64_t find_fork(json const &locator) const;
+  bool replace_blocks(uint64_t fork, std::vector<block> blocks);
+
+  void store_latest_block();
 #ifdef TRANSACTIONS
   void broadcast_transaction(transaction const &t);
+  void broadcast_transactions(std::vector<transaction> const &ts);
+
+  json add_transactions(json const &data, std::vector<transaction> &added);
+
+  // Returns whether a block was produced, blocks containing only the reward
+  // transaction are skipped unless allow_empty is set.
+  bool produce_block(std::string const &reward_address, bool allow_empty = true);
+
+  void block_template_notify();
+  void block_template_refresh();
+#else
+  bool produce_block();
 #endif // TRANSACTIONS
 
+  void producer_run();
+  void producer_notify();
+
   // XXX Use thread pool and join all threads before stopping.
   template<typename FUNC, typename ...ARGS>
   void detach(FUNC func, ARGS... args)
@@ -91,11 +146,65 @@ private:
 
   blockchain m_blockchain;
 
+  // Connected blocks are appended here if not null.
+  std::unique_ptr<block_store> m_block_store;
+
+  // Height from which the block store has to be resynchronized with the
+  // blockchain after failing to write to it.
+  std::optional<uint64_t> m_block_store_resync;
+
 #ifdef TRANSACTIONS
-  TransactionUnspentOutputs<> m_transaction_unspent_outputs;
-  TransactionUnconfirmedPool<> m_transaction_unconfirmed_pool;
+  ChainState<> m_chain_state;
+
+  // Transactions for the next block, selected from the unconfirmed pool and
+  // validated in the background whenever the pool or the chain changes. A
+  // template is only valid on top of the block it was assembled for.
+  struct BlockTemplate
+  {
+    std::size_t index;
+    Digest hash_prev; // Empty for the genesis block.
+    std::vector<transaction> ts;
+
+    bool same_parent(BlockTemplate const &other) const
+    { return index == other.index && hash_prev == other.hash_prev; }
+  };
+
+  // Empty template for the block following the latest one.
+  BlockTemplate block_template_next() const;
+
+  std::optional<BlockTemplate> m_block_template;
+  std::mutex m_block_template_mtx;
+  std::mutex m_block_template_refresh_mtx;
+  std::atomic<bool> m_block_template_refresh { false };
+#else
+  struct PendingEntry
+  {
+    Digest hash;
+    std::string text;
+    std::string salt; // Node UUID and sequence number, unique per entry.
+  };
+
+  // Text entries waiting to be committed, along with their hashes.
+  std::deque<PendingEntry> m_entries_pending;
+  std::unordered_set<Digest> m_entries_pending_hashes;
+  uint64_t m_entries_sequence { 0 };
+  mutable std::mutex m_entries_mtx;
 #endif // TRANSACTIONS
 
+  // Produces blocks once enough transactions or text entries are pending or
+  // the oldest pending one has waited long enough.
+  std::thread m_producer_thread;
+  std::mutex m_producer_mtx;
+  std::condition_variable m_producer_cv;
+  std::optional<clock::TimePoint> m_producer_deadline;
+  bool m_producer_stop { false };
+
+  // Serializes appending blocks and updating the state derived from them.
+  std::mutex m_connect_mtx;
+
+  // Held while synchronizing with a peer, further syncs are skipped meanwhile.
+  std::mutex m_sync_mtx;
+
   WebSocketServer m_websocket_server;
   WebSocketPeers m_websocket_peers;
 
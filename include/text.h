@@ -1,31 +1,122 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "crypto/digest.h"
+#include "crypto/hash.h"
 #include "json.h"
 
 namespace bc
 {
 
+// One or several text entries. A single entry is serialized as a plain string,
+// several entries are serialized as an array of strings. Entries may come with
+// salts, in which case both are serialized as { "entries": [...], "salts":
+// [...] }.
 class Text
 {
 public:
+  using value_type = std::string;
+
+  // Largest number of entries in a valid block, independent of the batch size
+  // configured for producing blocks.
+  static constexpr std::size_t ENTRIES_MAX { 1000 };
+
   Text(std::string text)
-  : m_text { std::move(text) }
+  : m_entries { std::move(text) }
+  {}
+
+  Text(std::vector<std::string> entries)
+  : m_entries { std::move(entries) }
+  {}
+
+  // One salt per entry, see hash.
+  Text(std::vector<std::string> entries, std::vector<std::string> salts)
+  : m_entries { std::move(entries) },
+    m_salts { std::move(salts) }
   {}
 
+  std::vector<std::string> const &get() const
+  { return m_entries; }
+
+  std::vector<Digest> hashes() const
+  {
+    std::vector<Digest> hashes;
+    for (std::size_t i { 0 }; i < m_entries.size(); ++i)
+      hashes.push_back(hash(m_entries[i], m_salts.empty() ? "" : m_salts[i]));
+
+    return hashes;
+  }
+
   std::pair<bool, std::string> valid(std::size_t) const
-  { return { true, "" }; }
+  {
+    if (m_entries.empty())
+      return { false, "no entries" };
+
+    if (m_entries.size() > ENTRIES_MAX)
+      return { false, "too many entries" };
+
+    if (!m_salts.empty() && m_salts.size() != m_entries.size())
+      return { false, "number of salts does not match number of entries" };
+
+    return { true, "" };
+  }
 
   json to_json() const
-  { return m_text; }
+  {
+    if (!m_salts.empty())
+      return { { "entries", m_entries }, { "salts", m_salts } };
+
+    if (m_entries.size() == 1)
+      return m_entries.front();
+
+    return m_entries;
+  }
 
   static Text from_json(json const &j)
-  { return Text(j.get<std::string>()); }
+  {
+    if (j.is_object()) {
+      return Text(j["entries"].get<std::vector<std::string>>(),
+                  j["salts"].get<std::vector<std::string>>());
+    }
+
+    if (j.is_array())
+      return Text(j.get<std::vector<std::string>>());
+
+    return Text(j.get<std::string>());
+  }
+
+  // Text entries are validated independently of each other.
+  struct chain_validator
+  {
+    std::pair<bool, std::string> operator()(Text &text, uint64_t index) const
+    { return text.valid(index); }
+
+    void skip(Text const &) const
+    {}
+
+    template<typename BLOCKS>
+    std::pair<bool, std::string> finish(BLOCKS const &) const
+    { return { true, "" }; }
+  };
+
+  // Entries are identified by their hash, which covers a salt if given so that
+  // entries with the same text can still be told apart.
+  static Digest hash(std::string const &entry, std::string const &salt = "")
+  {
+    if (salt.empty())
+      return SHA256Hasher::instance().hash(entry);
+
+    return SHA256Hasher::instance().hash(salt + ':' + entry);
+  }
 
 private:
-  std::string m_text;
+  std::vector<std::string> m_entries;
+  std::vector<std::string> m_salts; // Empty if the entries are unsalted.
 };
 
 } // end namespace bc
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+namespace bc
+{
+
+class ThreadPool
+{
+public:
+  explicit ThreadPool(std::size_t num_threads = default_num_threads())
+  : m_num_threads { num_threads },
+    m_pool { num_threads }
+  {}
+
+  ~ThreadPool()
+  { m_pool.join(); }
+
+  static ThreadPool &instance()
+  {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  std::size_t size() const
+  { return m_num_threads; }
+
+  template<typename FUNC>
+  void post(FUNC &&func)
+  { boost::asio::post(m_pool, std::forward<FUNC>(func)); }
+
+  // Calls func(i) for all i in [0, n) and waits until all calls have returned.
+  // The first exception thrown by any call is rethrown. Nested calls from
+  // within func run serially on the calling worker thread.
+  template<typename FUNC>
+  void parallel_for(std::size_t n, FUNC const &func)
+  {
+    if (n == 0)
+      return;
+
+    if (n == 1 || m_worker) {
+      for (std::size_t i { 0 }; i < n; ++i)
+        func(i);
+
+      return;
+    }
+
+    auto num_chunks { std::min(n, m_num_threads) };
+    auto chunk_size { (n + num_chunks - 1) / num_chunks };
+
+    num_chunks = (n + chunk_size - 1) / chunk_size;
+
+    std::latch done { static_cast<std::ptrdiff_t>(num_chunks) };
+
+    std::exception_ptr error;
+    std::mutex error_mtx;
+
+    for (std::size_t chunk { 0 }; chunk < num_chunks; ++chunk) {
+      post([&, chunk]{
+        m_worker = true;
+
+        try {
+          auto end { std::min(n, (chunk + 1) * chunk_size) };
+
+          for (std::size_t i { chunk * chunk_size }; i < end; ++i)
+            func(i);
+
+        } catch (...) {
+          std::scoped_lock lock { error_mtx };
+
+          if (!error)
+            error = std::current_exception();
+        }
+
+        m_worker = false;
+
+        done.count_down();
+      });
+    }
+
+    done.wait();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+private:
+  static std::size_t default_num_threads()
+  { return std::max(1u, std::thread::hardware_concurrency()); }
+
+  static inline thread_local bool m_worker { false };
+
+  std::size_t m_num_threads;
+
+  boost::asio::thread_pool m_pool;
+};
+
+} // end namespace bc
@@ -1,17 +1,28 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <boost/container/small_vector.hpp>
+
+#include "address.h"
+#include "clock.h"
 #include "config.h"
 #include "crypto/digest.h"
 #include "crypto/hash.h"
 #include "crypto/keypair.h"
 #include "format.h"
 #include "json.h"
+#include "thread_pool.h"
 
 namespace bc
 {
@@ -19,6 +30,27 @@ namespace bc
 template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
 class Transaction
 {
+  struct TxOutpoint // Reference to a TxO.
+  {
+    Digest output_hash; // Hash of transaction containing TxO.
+    std::size_t output_index; // Index of TxO in transaction.
+
+    bool operator==(TxOutpoint const &other) const
+    {
+      return output_hash == other.output_hash &&
+             output_index == other.output_index;
+    }
+
+    struct hash
+    {
+      std::size_t operator()(TxOutpoint const &outpoint) const
+      {
+        return std::hash<Digest>()(outpoint.output_hash) ^
+               std::hash<std::size_t>()(outpoint.output_index);
+      }
+    };
+  };
+
   struct TxI // Transaction input.
   {
     Digest output_hash; // Hash of transaction containing TxO.
@@ -31,6 +63,9 @@ class Transaction
              output_index == other.output_index;
     }
 
+    TxOutpoint outpoint() const
+    { return { output_hash, output_index }; }
+
     json to_json() const;
     static TxI from_json(json const &j);
   };
@@ -46,9 +81,24 @@ class Transaction
 
   struct UTxO // Unspent transaction output.
   {
+    // Unlike the transactions themselves, unspent outputs are long-lived so
+    // their addresses are interned. They are only created for outputs of
+    // pooled transactions and of blocks being connected, never while parsing.
+    struct Output
+    {
+      std::size_t amount; // Number of coins sent.
+      Address address; // Receiving wallet address.
+    };
+
+    UTxO(Digest hash, std::size_t index, TxO const &txo)
+    : output_hash { std::move(hash) }
+    , output_index { index }
+    , output { txo.amount, Address { txo.address } }
+    {}
+
     Digest output_hash; // Hash of transaction containing TxO.
     std::size_t output_index; // Index of TxO in transaction.
-    TxO output;
+    Output output;
 
     bool operator==(UTxO const &other) const
     {
@@ -62,6 +112,9 @@ class Transaction
              output_index == other.output_index;
     }
 
+    TxOutpoint outpoint() const
+    { return { output_hash, output_index }; }
+
     json to_json() const;
   };
 
@@ -72,79 +125,153 @@ public:
     REWARD
   };
 
+  using outpoint = TxOutpoint;
   using input = TxI;
   using output = TxO;
   using unspent_output = UTxO;
 
+  // Most transactions have few inputs and outputs (e.g. one payment and one
+  // change output), these are stored inline in the shared transaction data.
+  using input_vector = boost::container::small_vector<input, 2>;
+  using output_vector = boost::container::small_vector<output, 2>;
+
   Type type() const
-  { return m_type; }
+  { return m_data->type; }
 
   std::size_t index() const
-  { return m_index; }
+  { return m_data->index; }
 
-  Digest hash() const
-  { return m_hash; }
+  Digest const &hash() const
+  { return m_data->hash; }
 
-  std::vector<input> const &inputs() const
-  { return m_inputs; }
+  input_vector const &inputs() const
+  { return m_data->inputs; }
 
-  std::vector<output> const &outputs() const
-  { return m_outputs; }
+  output_vector const &outputs() const
+  { return m_data->outputs; }
 
   std::list<unspent_output> const &unspent_outputs() const
   { return m_unspent_outputs; }
 
+  std::size_t size() const;
+
   void update_unspent_outputs(std::list<unspent_output> unspent_outputs)
   { m_unspent_outputs = std::move(unspent_outputs); }
 
-  std::pair<bool, std::string> valid() const
+  // Transactions are validated in two phases, the first one only depends on
+  // the transaction itself while the second one requires the unspent outputs
+  // referenced by the transaction's inputs to have been linked.
+  std::pair<bool, std::string> valid_stateless() const
   {
-    switch (m_type) {
+    switch (type()) {
     case Type::REWARD:
       return valid_reward();
     default:
-      return valid_standard();
+      return valid_standard_stateless();
+    }
+  }
+
+  // Signature verification can be skipped for transactions assumed to be
+  // valid, e.g. below a checkpoint, and performed separately later.
+  std::pair<bool, std::string> valid_inputs(bool verify_signatures = true) const
+  {
+    switch (type()) {
+    case Type::REWARD:
+      return { true, "" };
+    default:
+      return valid_standard_inputs(verify_signatures);
+    }
+  }
+
+  std::pair<bool, std::string> valid_signatures() const
+  {
+    switch (type()) {
+    case Type::REWARD:
+      return { true, "" };
+    default:
+      return valid_standard_signatures();
     }
   }
 
+  std::pair<bool, std::string> valid() const
+  {
+    auto [valid, error] = valid_stateless();
+
+    if (!valid)
+      return { false, error };
+
+    return valid_inputs();
+  }
+
   static Transaction reward(std::string const &reward_address, std::size_t index);
 
-  json to_json() const;
+  json const &to_json() const;
   static Transaction from_json(json const &j);
 
 private:
   Transaction(Type type,
               std::size_t index,
               Digest hash,
-              std::vector<TxI> inputs,
-              std::vector<TxO> outputs)
-  : m_type { type }
-  , m_index { index }
-  , m_hash { std::move(hash) }
-  , m_inputs { std::move(inputs) }
-  , m_outputs { std::move(outputs) }
+              input_vector inputs,
+              output_vector outputs)
+  : m_data { std::make_shared<Data const>(
+      type, index, std::move(hash), std::move(inputs), std::move(outputs)) }
   {}
 
-  std::pair<bool, std::string> valid_standard() const;
+  std::pair<bool, std::string> valid_standard_stateless() const;
+  std::pair<bool, std::string> valid_standard_inputs(bool verify_signatures) const;
+  std::pair<bool, std::string> valid_standard_signatures() const;
   std::pair<bool, std::string> valid_reward() const;
 
   Digest determine_hash() const;
 
-  Type m_type;
-  std::size_t m_index;
-  Digest m_hash;
+  // Transaction contents, immutable once constructed and thus shared between
+  // all copies of a transaction, e.g. in the pool, in blocks and in relayed
+  // messages.
+  struct Data
+  {
+    Data(Type type,
+         std::size_t index,
+         Digest hash,
+         input_vector inputs,
+         output_vector outputs)
+    : type { type },
+      index { index },
+      hash { std::move(hash) },
+      inputs { std::move(inputs) },
+      outputs { std::move(outputs) }
+    {}
+
+    Type type;
+    std::size_t index;
+    Digest hash;
+
+    input_vector inputs;
+    output_vector outputs;
+
+    // Serialization, created on first use.
+    mutable std::once_flag serialized_once;
+    mutable json serialized;
+  };
 
-  std::vector<input> m_inputs;
-  std::vector<output> m_outputs;
+  std::shared_ptr<Data const> m_data;
+
+  // Outputs spent by this transaction, linked per copy prior to validation.
   std::list<unspent_output> m_unspent_outputs;
 };
 
+template<typename KEY_PAIR, typename HASHER>
+class TransactionChainValidator;
+
 template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
 class TransactionList
 {
   using transaction = Transaction<KEY_PAIR, HASHER>;
 
 public:
+  using value_type = transaction;
+  using chain_validator = TransactionChainValidator<KEY_PAIR, HASHER>;
+
   template<typename IT>
   TransactionList(IT start, IT end)
   : m_transactions { start, end }
@@ -156,12 +283,27 @@ public:
   std::vector<transaction> const &get() const
   { return m_transactions; }
 
+  std::vector<Digest> hashes() const
+  {
+    std::vector<Digest> hashes;
+    for (auto const &t : m_transactions)
+      hashes.push_back(t.hash());
+
+    return hashes;
+  }
+
+  std::pair<bool, std::string> valid_stateless(std::size_t index) const;
+  std::pair<bool, std::string> valid_inputs(bool verify_signatures = true) const;
+  std::pair<bool, std::string> valid_signatures() const;
   std::pair<bool, std::string> valid(std::size_t index) const;
 
   json to_json() const;
   static TransactionList from_json(json const &j);
 
 private:
+  static std::pair<bool, std::string> first_invalid(
+    std::vector<std::pair<bool, std::string>> const &results);
+
   std::vector<transaction> m_transactions;
 };
 
@@ -171,19 +313,159 @@ class TransactionUnspentOutputs
   using transaction = Transaction<KEY_PAIR, HASHER>;
   using transaction_list = TransactionList<KEY_PAIR, HASHER>;
 
+  using outpoint = typename transaction::outpoint;
+  using unspent_output = typename transaction::unspent_output;
+
 public:
-  std::list<typename transaction::unspent_output> const &get() const
+  // Outputs spent by a transaction, each along with the output following it
+  // at the time, so that reverting the transaction restores their order.
+  using spent_outputs = std::vector<std::pair<unspent_output, std::optional<outpoint>>>;
+
+  TransactionUnspentOutputs() = default;
+
+  // Outputs of 'base' are included unless spent, e.g. to validate blocks on
+  // top of a set of unspent outputs without copying it. 'base' must outlive
+  // this object and must not change in the meantime.
+  explicit TransactionUnspentOutputs(TransactionUnspentOutputs const &base)
+  : m_base { &base }
+  {}
+
+  // Excludes outputs of the base.
+  std::list<unspent_output> const &get() const
   { return m_unspent_outputs; }
 
-  void update(transaction const &t);
+  unspent_output const *find(outpoint const &o) const;
+
+  bool contains(outpoint const &o) const
+  { return find(o) != nullptr; }
+
+  std::list<unspent_output> resolve(transaction const &t) const;
+
+  void link(transaction_list &ts) const;
+
+  // If given, 'spent' receives the outputs spent by t.
+  void update(transaction const &t, spent_outputs *spent = nullptr);
+
+  // Undoes update, transactions have to be reverted latest first.
+  void revert(transaction const &t, spent_outputs const &spent);
 
   void clear()
-  { m_unspent_outputs.clear(); }
+  {
+    m_unspent_outputs.clear();
+    m_index.clear();
+    m_spent_base.clear();
+  }
 
   json to_json() const;
 
 private:
-  std::list<typename transaction::unspent_output> m_unspent_outputs;
+  using iterator = typename std::list<unspent_output>::iterator;
+
+  void insert(unspent_output utxo, std::optional<outpoint> const &next);
+  void erase(outpoint const &o, spent_outputs *spent);
+
+  std::list<unspent_output> m_unspent_outputs;
+  std::unordered_map<outpoint, iterator, typename outpoint::hash> m_index;
+
+  TransactionUnspentOutputs const *m_base { nullptr };
+  std::unordered_set<outpoint, typename outpoint::hash> m_spent_base;
+};
+
+// Validates the transactions of consecutive blocks starting at the genesis
+// block, e.g. while loading a blockchain, keeping track of the outputs they
+// leave unspent. Signatures are verified in parallel across blocks by finish,
+// skipping blocks below the assume-valid checkpoint unless the chain ends
+// before reaching it.
+template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
+class TransactionChainValidator
+{
+  using transaction_list = TransactionList<KEY_PAIR, HASHER>;
+  using unspent_outputs = TransactionUnspentOutputs<KEY_PAIR, HASHER>;
+
+public:
+  TransactionChainValidator() = default;
+
+  // Validates blocks following those that left 'base' unspent.
+  explicit TransactionChainValidator(unspent_outputs const &base)
+  : m_unspent_outputs { base }
+  {}
+
+  std::pair<bool, std::string> operator()(transaction_list &ts, uint64_t index);
+
+  // Accounts for the transactions of an already validated block.
+  void skip(transaction_list const &ts);
+
+  // Expects the blocks previously passed to operator(), not necessarily
+  // starting at the genesis block.
+  template<typename BLOCKS>
+  std::pair<bool, std::string> finish(BLOCKS const &blocks) const
+  {
+    if (blocks.empty())
+      return { true, "" };
+
+    uint64_t offset { blocks[0].index() };
+
+    uint64_t first { m_checkpoint_reached ? config().checkpoint_height : 0 };
+    first = first > offset ? first - offset : 0;
+
+    if (first >= blocks.size())
+      return { true, "" };
+
+    std::vector<std::pair<bool, std::string>> results(blocks.size() - first);
+
+    ThreadPool::instance().parallel_for(results.size(), [&](std::size_t i){
+      results[i] = blocks[first + i].data().valid_signatures();
+    });
+
+    for (std::size_t i { 0 }; i < results.size(); ++i) {
+      auto const &[valid, error] = results[i];
+
+      if (!valid)
+        return { false, fmt::format("block {}: {}", offset + first + i, error) };
+    }
+
+    return { true, "" };
+  }
+
+private:
+  unspent_outputs m_unspent_outputs;
+
+  bool m_checkpoint_reached { false };
+};
+
+template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
+class TransactionAddressIndex
+{
+  using transaction = Transaction<KEY_PAIR, HASHER>;
+  using spent_outputs = typename TransactionUnspentOutputs<KEY_PAIR, HASHER>::spent_outputs;
+
+public:
+  struct Entry // Confirmed transaction touching an address.
+  {
+    Digest hash; // Transaction hash.
+    std::size_t index; // Index of block containing the transaction.
+  };
+
+  // Up to limit transactions touching an address, in chain order, starting
+  // with the cursor-th one.
+  std::vector<Entry> find(std::string const &address,
+                          std::size_t cursor,
+                          std::size_t limit) const;
+
+  // Record a transaction given the outputs it spends.
+  void connect(transaction const &t, spent_outputs const &spent);
+
+  // Undoes connect, transactions have to be disconnected latest first.
+  void disconnect(transaction const &t, spent_outputs const &spent);
+
+  void clear()
+  { m_entries.clear(); }
+
+private:
+  static std::vector<Address> addresses(transaction const &t,
+                                        spent_outputs const &spent);
+
+  std::unordered_map<Address, std::vector<Entry>> m_entries;
 };
 
 template<typename KEY_PAIR = ECSecp256k1KeyPair, typename HASHER = SHA256Hasher>
@@ -191,29 +473,83 @@ class TransactionUnconfirmedPool
 {
   using transaction = Transaction<KEY_PAIR, HASHER>;
   using transaction_list = TransactionList<KEY_PAIR, HASHER>;
+  using outpoint = typename transaction::outpoint;
+  using unspent_output = typename transaction::unspent_output;
+
+  struct Entry // Pooled transaction.
+  {
+    transaction t;
+    clock::TimePoint added; // Time at which the transaction was pooled.
+    std::size_t size; // Number of bytes accounted for the transaction.
+    std::vector<Digest> parents; // Pooled transactions whose outputs t spends.
+    std::vector<Digest> children; // Pooled transactions spending outputs of t.
+  };
 
 public:
   bool empty() const
-  { return m_transactions.empty(); }
+  { return m_entries.empty(); }
 
-  std::list<transaction> const &get()
-  { return m_transactions; }
+  std::size_t size() const
+  { return m_entries.size(); }
+
+  std::size_t size_bytes() const
+  { return m_size_bytes; }
+
+  bool contains(Digest const &hash) const
+  { return m_by_hash.find(hash) != m_by_hash.end(); }
+
+  std::optional<transaction> find(Digest const &hash) const
+  {
+    auto it { m_by_hash.find(hash) };
+    if (it == m_by_hash.end())
+      return std::nullopt;
+
+    return it->second->t;
+  }
+
+  std::list<unspent_output> resolve(transaction const &t) const;
 
-  transaction next();
+  // Up to n pooled transactions that can go into the block with the given
+  // index, i.e. that have that index and whose pooled parents are selected
+  // as well.
+  std::vector<transaction> select(std::size_t n, std::size_t index);
 
   void add(transaction const &t);
 
   void remove(transaction const &t);
 
-  void prune(std::list<typename transaction::unspent_output> const &unspent_outputs);
+  void prune(transaction const &t);
+
+  // Evicts transactions for blocks before the given index, they can no longer
+  // be confirmed.
+  void prune_index(std::size_t index);
+
+  void expire();
 
   void clear()
-  { m_transactions.clear(); }
+  {
+    m_entries.clear();
+    m_by_hash.clear();
+    m_by_outpoint.clear();
+    m_size_bytes = 0;
+  }
 
   json to_json() const;
 
 private:
-  std::list<transaction> m_transactions;
+  using iterator = typename std::list<Entry>::iterator;
+
+  void erase(iterator it);
+  void evict(iterator it);
+
+  // Pooled transactions, oldest first. Since a transaction can only be added
+  // after all pooled transactions it depends on, ancestors precede descendants.
+  std::list<Entry> m_entries;
+  std::size_t m_size_bytes { 0 };
+
+  // Pooled transactions by hash and by the outputs spent by their inputs.
+  std::unordered_map<Digest, iterator> m_by_hash;
+  std::unordered_map<outpoint, iterator, typename outpoint::hash> m_by_outpoint;
 };
 
 } // end namespace bc
@@ -4,6 +4,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -37,6 +38,9 @@ public:
   uint16_t port() const
   { return m_port; }
 
+  // Targets may contain parameters, e.g. '/blocks/{index}'. Their values, as
+  // well as those of any query parameters, are passed to the handler as
+  // string members of its (object) argument.
   void support(std::string const &target,
                method const &method,
                handler handler);
@@ -47,7 +51,9 @@ public:
 private:
   std::pair<status, json> handle(std::string const &target,
                                  method const &method,
-                                 json const &data) const;
+                                 json data) const;
+
+  static bool match(std::string_view pattern, std::string_view path, json &params);
 
   std::string m_host;
   uint16_t m_port;
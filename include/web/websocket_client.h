@@ -3,9 +3,11 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
+#include "clock.h"
 #include "json.h"
 
 namespace bc
@@ -31,7 +33,12 @@ public:
   { return m_port; }
 
   std::pair<bool, std::string> send_sync(json const &data) const;
-  void send_async(json const &data, callback cb) const;
+
+  // A request that is not answered within 'timeout' fails, which also aborts
+  // the connection. The next request then reconnects.
+  void send_async(json const &data,
+                  callback cb,
+                  std::optional<clock::TimeInterval> timeout = std::nullopt) const;
 
   void run() const;
 
@@ -40,7 +47,7 @@ private:
   uint16_t m_port;
 
   std::unique_ptr<Context> m_context;
-  std::shared_ptr<Connection> m_connection;
+  mutable std::shared_ptr<Connection> m_connection;
 };
 
 } // end namespace bc
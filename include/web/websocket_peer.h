@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <deque>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -24,11 +25,13 @@ public:
   uint16_t port() const
   { return m_client.port(); }
 
-  void send(json request, WebSocketClient::callback cb) const
+  void send(json request,
+            WebSocketClient::callback cb,
+            std::optional<clock::TimeInterval> timeout = std::nullopt) const
   {
     std::scoped_lock lock { m_mtx };
 
-    m_client.send_async(std::move(request), std::move(cb));
+    m_client.send_async(std::move(request), std::move(cb), timeout);
 
     m_client.run();
   }
@@ -70,7 +73,10 @@ public:
     return 0;
   }
 
-  void send(std::size_t peer_id, json request, WebSocketClient::callback cb) const
+  void send(std::size_t peer_id,
+            json request,
+            WebSocketClient::callback cb,
+            std::optional<clock::TimeInterval> timeout = std::nullopt) const
   {
     WebSocketPeer const *peer;
 
@@ -80,7 +86,7 @@ public:
       peer = &m_list[peer_id - 1];
     }
 
-    peer->send(std::move(request), std::move(cb));
+    peer->send(std::move(request), std::move(cb), timeout);
   }
 
   json to_json() const
@@ -0,0 +1,241 @@
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "chain_state.h"
+#include "config.h"
+#include "format.h"
+#include "json.h"
+#include "transaction.h"
+
+namespace bc
+{
+
+template<typename KEY_PAIR, typename HASHER>
+std::list<typename Transaction<KEY_PAIR, HASHER>::unspent_output>
+ChainState<KEY_PAIR, HASHER>::resolve(transaction const &t) const
+{
+  // Assumes that both the unspent outputs and the pool are locked.
+  auto unspent_outputs { m_unspent_outputs.resolve(t) };
+
+  unspent_outputs.splice(unspent_outputs.end(), m_unconfirmed_pool.resolve(t));
+
+  return unspent_outputs;
+}
+
+template std::list<typename Transaction<>::unspent_output>
+ChainState<>::resolve(transaction const &t) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::link(transaction &t) const
+{
+  std::shared_lock lock_unspent_outputs { m_unspent_outputs_mtx };
+  std::scoped_lock lock_unconfirmed_pool { m_unconfirmed_pool_mtx };
+
+  t.update_unspent_outputs(resolve(t));
+}
+
+template void ChainState<>::link(transaction &t) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::link(transaction_list &ts) const
+{
+  std::shared_lock lock { m_unspent_outputs_mtx };
+
+  m_unspent_outputs.link(ts);
+}
+
+template void ChainState<>::link(transaction_list &ts) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::add(transaction t)
+{
+  // Only linking and insertion need any locks, validation and in particular
+  // signature verification happen outside of them.
+  auto [valid, error] = t.valid_stateless();
+
+  if (valid) {
+    link(t);
+
+    std::tie(valid, error) = t.valid_inputs();
+  }
+
+  if (!valid)
+    throw std::runtime_error(
+      fmt::format("attempted to add invalid transaction to pool: {}", error));
+
+  std::shared_lock lock_unspent_outputs { m_unspent_outputs_mtx };
+  std::scoped_lock lock_unconfirmed_pool { m_unconfirmed_pool_mtx };
+
+  // Outputs might have been spent by another thread in the meantime.
+  if (resolve(t).size() != t.unspent_outputs().size())
+    throw std::runtime_error(
+      "attempted to add invalid transaction to pool: inputs spent concurrently");
+
+  m_unconfirmed_pool.add(t);
+}
+
+template void ChainState<>::add(transaction t);
+
+template<typename KEY_PAIR, typename HASHER>
+std::vector<Transaction<KEY_PAIR, HASHER>>
+ChainState<KEY_PAIR, HASHER>::select(std::size_t n, std::size_t index)
+{
+  std::scoped_lock lock { m_unconfirmed_pool_mtx };
+
+  return m_unconfirmed_pool.select(n, index);
+}
+
+template std::vector<Transaction<>> ChainState<>::select(std::size_t n, std::size_t index);
+
+template<typename KEY_PAIR, typename HASHER>
+std::optional<Transaction<KEY_PAIR, HASHER>>
+ChainState<KEY_PAIR, HASHER>::find_unconfirmed(Digest const &hash) const
+{
+  std::scoped_lock lock { m_unconfirmed_pool_mtx };
+
+  return m_unconfirmed_pool.find(hash);
+}
+
+template std::optional<Transaction<>> ChainState<>::find_unconfirmed(Digest const &hash) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::connect(transaction_list const &ts, std::size_t index)
+{
+  std::unique_lock lock_unspent_outputs { m_unspent_outputs_mtx };
+  std::scoped_lock lock_unconfirmed_pool { m_unconfirmed_pool_mtx };
+
+  if (index != m_undo.size())
+    throw std::logic_error("attempted connecting blocks out of order");
+
+  auto &undo { m_undo.emplace_back(ts, std::vector<spent_outputs>(ts.get().size())) };
+
+  for (std::size_t i { 0 }; i < ts.get().size(); ++i) {
+    auto const &t { ts.get()[i] };
+
+    m_unspent_outputs.update(t, &undo.spent[i]);
+
+    if (config().transaction_address_index)
+      m_address_index.connect(t, undo.spent[i]);
+
+    m_unconfirmed_pool.remove(t);
+    m_unconfirmed_pool.prune(t);
+  }
+
+  m_unconfirmed_pool.prune_index(index + 1);
+}
+
+template void ChainState<>::connect(transaction_list const &ts, std::size_t index);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::disconnect(std::size_t fork)
+{
+  std::unique_lock lock_unspent_outputs { m_unspent_outputs_mtx };
+  std::scoped_lock lock_unconfirmed_pool { m_unconfirmed_pool_mtx };
+
+  while (m_undo.size() > fork) {
+    auto const &undo { m_undo.back() };
+    auto const &ts { undo.ts.get() };
+
+    for (std::size_t i { ts.size() }; i-- > 0;) {
+      if (config().transaction_address_index)
+        m_address_index.disconnect(ts[i], undo.spent[i]);
+
+      m_unspent_outputs.revert(ts[i], undo.spent[i]);
+    }
+
+    m_undo.pop_back();
+  }
+
+  m_unconfirmed_pool.clear();
+}
+
+template void ChainState<>::disconnect(std::size_t fork);
+
+template<typename KEY_PAIR, typename HASHER>
+ChainState<KEY_PAIR, HASHER>::Validator::Validator(ChainState const &chain_state,
+                                                   std::size_t fork)
+: m_lock { chain_state.m_unspent_outputs_mtx },
+  m_unspent_outputs { chain_state.m_unspent_outputs }
+{
+  auto const &undo { chain_state.m_undo };
+
+  if (fork > undo.size())
+    throw std::logic_error("attempted validating blocks beyond the end of the chain state");
+
+  for (std::size_t i { undo.size() }; i-- > fork;) {
+    auto const &ts { undo[i].ts.get() };
+
+    for (std::size_t j { ts.size() }; j-- > 0;)
+      m_unspent_outputs.revert(ts[j], undo[i].spent[j]);
+  }
+}
+
+template ChainState<>::Validator::Validator(ChainState const &chain_state, std::size_t fork);
+
+template<typename KEY_PAIR, typename HASHER>
+std::vector<typename TransactionAddressIndex<KEY_PAIR, HASHER>::Entry>
+ChainState<KEY_PAIR, HASHER>::address_transactions(std::string const &address,
+                                                   std::size_t cursor,
+                                                   std::size_t limit) const
+{
+  std::shared_lock lock { m_unspent_outputs_mtx };
+
+  return m_address_index.find(address, cursor, limit);
+}
+
+template std::vector<TransactionAddressIndex<>::Entry>
+ChainState<>::address_transactions(std::string const &address,
+                                   std::size_t cursor,
+                                   std::size_t limit) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+ChainState<KEY_PAIR, HASHER>::clear()
+{
+  std::unique_lock lock_unspent_outputs { m_unspent_outputs_mtx };
+  std::scoped_lock lock_unconfirmed_pool { m_unconfirmed_pool_mtx };
+
+  m_unspent_outputs.clear();
+  m_address_index.clear();
+  m_undo.clear();
+  m_unconfirmed_pool.clear();
+}
+
+template void ChainState<>::clear();
+
+template<typename KEY_PAIR, typename HASHER>
+json
+ChainState<KEY_PAIR, HASHER>::unspent_outputs_to_json() const
+{
+  std::shared_lock lock { m_unspent_outputs_mtx };
+
+  return m_unspent_outputs.to_json();
+}
+
+template json ChainState<>::unspent_outputs_to_json() const;
+
+template<typename KEY_PAIR, typename HASHER>
+json
+ChainState<KEY_PAIR, HASHER>::unconfirmed_pool_to_json() const
+{
+  std::scoped_lock lock { m_unconfirmed_pool_mtx };
+
+  return m_unconfirmed_pool.to_json();
+}
+
+template json ChainState<>::unconfirmed_pool_to_json() const;
+
+} // end namespace bc
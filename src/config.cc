@@ -1,3 +1,4 @@
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -73,8 +74,88 @@ Config Config::from_toml(std::string const &filename)
     toml_assign<std::size_t>(
       cfg.transaction_reward_amount, t,
       "reward_amount");
+    toml_assign<std::size_t>(
+      cfg.transaction_pool_size_max, t,
+      "pool_size_max");
+    toml_assign<clock::TimeInterval::rep>(
+      cfg.transaction_pool_expiry, t,
+      "pool_expiry");
+
+    std::string eviction;
+    toml_assign<std::string>(eviction, t, "pool_eviction");
+
+    if (eviction == "reject")
+      cfg.transaction_pool_eviction = PoolEviction::REJECT;
+    else if (eviction == "oldest")
+      cfg.transaction_pool_eviction = PoolEviction::OLDEST;
+    else if (!eviction.empty())
+      throw std::invalid_argument("invalid pool eviction policy: " + eviction);
+
+    toml_assign<bool>(
+      cfg.transaction_address_index, t,
+      "address_index");
+  });
+
+  toml_for_table(t, "producer", [&cfg](auto const &t) {
+    toml_assign<bool>(
+      cfg.producer_enabled, t,
+      "enabled");
+    toml_assign<std::size_t>(
+      cfg.producer_fill_threshold, t,
+      "fill_threshold");
+    toml_assign<clock::TimeInterval::rep>(
+      cfg.producer_latency_max, t,
+      "latency_max");
+    toml_assign<std::string>(
+      cfg.producer_reward_address, t,
+      "reward_address");
   });
 
+  toml_for_table(t, "text", [&cfg](auto const &t) {
+    toml_assign<std::size_t>(
+      cfg.text_batch_size, t,
+      "batch_size");
+    toml_assign<clock::TimeInterval::rep>(
+      cfg.text_batch_latency_max, t,
+      "batch_latency_max");
+  });
+
+  toml_for_table(t, "store", [&cfg](auto const &t) {
+    toml_assign<std::size_t>(
+      cfg.store_segment_size_max, t,
+      "segment_size_max");
+    toml_assign<std::size_t>(
+      cfg.store_sync_after, t,
+      "sync_after");
+  });
+
+  toml_for_table(t, "checkpoint", [&cfg](auto const &t) {
+    toml_assign<uint64_t>(
+      cfg.checkpoint_height, t,
+      "height");
+    toml_assign<std::string>(
+      cfg.checkpoint_hash, t,
+      "hash");
+  });
+
+  toml_for_table(t, "sync", [&cfg](auto const &t) {
+    toml_assign<std::size_t>(
+      cfg.sync_headers_max, t,
+      "headers_max");
+    toml_assign<std::size_t>(
+      cfg.sync_headers_total_max, t,
+      "headers_total_max");
+    toml_assign<std::size_t>(
+      cfg.sync_window_size, t,
+      "window_size");
+    toml_assign<clock::TimeInterval::rep>(
+      cfg.sync_timeout, t,
+      "timeout");
+  });
+
+  if (cfg.producer_enabled && cfg.producer_reward_address.empty())
+    throw std::invalid_argument("block producer enabled without reward address");
+
   return cfg;
 }
 
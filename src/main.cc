@@ -1,12 +1,15 @@
 #include <cassert>
+#include <chrono>
+#include <csignal>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
+#include <filesystem>
 #include <iostream>
 #include <memory>
-#include <sstream>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
+#include <thread>
 #include <utility>
 
 #include <boost/program_options.hpp>
@@ -31,6 +34,7 @@ void parse_options(int argc,
                    std::string &http_host,
                    uint16_t &http_port,
                    std::string &blockchain,
+                   std::string &block_store,
                    std::string &configuration,
                    bool verbose)
 {
@@ -43,7 +47,8 @@ void parse_options(int argc,
     ("websocket-port", po::value<uint16_t>(&websocket_port)->default_value(8332), "websocket server port")
     ("http-host", po::value<std::string>(&http_host)->default_value("127.0.0.1"), "http server ip")
     ("http-port", po::value<uint16_t>(&http_port)->default_value(8333), "http server port")
-    ("blockchain", po::value<std::string>(&blockchain)->default_value(""), "persisted blockchain file")
+    ("blockchain", po::value<std::string>(&blockchain)->default_value(""), "persisted blockchain file or block store")
+    ("block-store", po::value<std::string>(&block_store)->default_value(""), "block store to which blocks are appended")
     ("config", po::value<std::string>(&configuration)->default_value(""), "configuration file")
     ("verbose", po::bool_switch(&verbose)->default_value(false), "verbose log output");
 
@@ -58,14 +63,16 @@ void create_node(std::string const &name,
                  uint16_t websocket_port,
                  std::string const &http_host,
                  uint16_t http_port,
-                 Node::blockchain bc)
+                 Node::blockchain bc,
+                 std::unique_ptr<Node::block_store> store)
 {
   node = std::make_unique<Node>(name,
                                 websocket_host,
                                 websocket_port,
                                 http_host,
                                 http_port,
-                                std::move(bc));
+                                std::move(bc),
+                                std::move(store));
 }
 
 void run_node()
@@ -75,11 +82,25 @@ void run_node()
   node->run();
 }
 
-void stop_node(int)
+// Stopping the node takes locks, which is not safe from within a signal
+// handler, so the handler only sets a flag that a regular thread polls.
+volatile std::sig_atomic_t termination_requested { 0 };
+
+void request_termination(int)
+{ termination_requested = 1; }
+
+void stop_node_on_termination(std::stop_token stop)
 {
   assert(node);
 
-  node->stop();
+  while (!stop.stop_requested()) {
+    if (termination_requested) {
+      node->stop();
+      return;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds { 100 });
+  }
 }
 
 } // end namespace
@@ -95,6 +116,7 @@ int main(int argc, char **argv)
     std::string http_host;
     uint16_t http_port;
     std::string blockchain;
+    std::string block_store;
     std::string configuration;
     bool verbose;
 
@@ -106,37 +128,58 @@ int main(int argc, char **argv)
                   http_host,
                   http_port,
                   blockchain,
+                  block_store,
                   configuration,
                   verbose);
 
+    // Blocks are validated against the configuration while loading them.
+    if (configuration.empty())
+      config() = Config::from_defaults();
+    else
+      config() = Config::from_toml(configuration);
+
+    log::init(verbose ? log::DEBUG : log::INFO);
+
+    // A block store passed in via '--blockchain' is also appended to.
+    if (!blockchain.empty() && std::filesystem::is_directory(blockchain)) {
+      if (!block_store.empty() && block_store != blockchain)
+        throw std::runtime_error { "conflicting block stores" };
+
+      block_store = blockchain;
+      blockchain.clear();
+    }
+
     Node::blockchain bc;
 
     if (!blockchain.empty()) {
-      std::ifstream f { blockchain };
-      if (!f)
-        throw std::runtime_error { "failed to open blockchain file" };
+      // Parse straight from the mapped file instead of reading it into memory.
+      nix::MappedFile f { blockchain };
 
-      std::stringstream ss;
-      ss << f.rdbuf();
-
-      bc = Node::blockchain::from_json(json::parse(ss.str()));
+      bc = Node::blockchain::parse(f.begin(), f.end());
     }
 
-    if (configuration.empty())
-      config() = Config::from_defaults();
-    else
-      config() = Config::from_toml(configuration);
+    std::unique_ptr<Node::block_store> store;
 
-    log::init(verbose ? log::DEBUG : log::INFO);
+    if (!block_store.empty()) {
+      store = std::make_unique<Node::block_store>(block_store);
+
+      // The block store is brought in line with an explicitly passed
+      // blockchain file by the node.
+      if (bc.empty())
+        bc = Node::blockchain::load([&store](auto &&append){ store->for_each(append); });
+    }
 
     create_node(name,
                 websocket_host,
                 websocket_port,
                 http_host,
                 http_port,
-                std::move(bc));
+                std::move(bc),
+                std::move(store));
+
+    nix::on_termination(request_termination);
 
-    nix::on_termination(stop_node);
+    std::jthread stopper { stop_node_on_termination };
 
     run_node();
 
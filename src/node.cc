@@ -1,15 +1,25 @@
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <fstream>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "blockchain.h"
 #include "config.h"
 #include "json.h"
 #include "log.h"
 #include "node.h"
+#include "thread_pool.h"
 #include "uuid.h"
 #include "web/http_error.h"
 #include "web/http_server.h"
@@ -20,24 +30,57 @@
 namespace bc
 {
 
+namespace
+{
+
+#ifdef TRANSACTIONS
+
+bool producer_enabled()
+{ return config().producer_enabled; }
+
+std::size_t producer_fill_threshold()
+{ return config().producer_fill_threshold; }
+
+clock::TimeInterval producer_latency_max()
+{ return config().producer_latency_max; }
+
+#else
+
+// Text entries are always committed in batches.
+bool producer_enabled()
+{ return true; }
+
+std::size_t producer_fill_threshold()
+{ return std::min(config().text_batch_size, Text::ENTRIES_MAX); }
+
+clock::TimeInterval producer_latency_max()
+{ return config().text_batch_latency_max; }
+
+#endif // TRANSACTIONS
+
+} // end namespace
+
 Node::Node(std::string const &name,
            std::string const &websocket_addr,
            uint16_t websocket_port,
            std::string const &http_addr,
            uint16_t http_port,
-           blockchain bc)
+           blockchain bc,
+           std::unique_ptr<block_store> store)
 : m_name { name },
   m_log { "[{}] [{}]", m_name, m_uuid.to_string(true) },
   m_websocket_server { websocket_addr, websocket_port },
   m_http_server { http_addr, http_port },
-  m_blockchain { std::move(bc) }
+  m_blockchain { std::move(bc) },
+  m_block_store { std::move(store) }
 {
   websocket_setup();
   http_setup();
   blockchain_setup();
+  block_store_setup();
 }
 
-void Node::run() const
+void Node::run()
 {
   m_log.info("Running node");
 
@@ -50,16 +93,35 @@ void Node::run() const
   std::thread websocket_server_thread([this]{ m_websocket_server.run(); });
   std::thread http_server_thread([this]{ m_http_server.run(); });
 
+  if (producer_enabled()) {
+    m_log.info("Producing blocks after {} pending items or {} ms",
+               producer_fill_threshold(),
+               producer_latency_max().count());
+
+    m_producer_thread = std::thread([this]{ producer_run(); });
+  }
+
   websocket_server_thread.join();
   http_server_thread.join();
+
+  if (m_producer_thread.joinable())
+    m_producer_thread.join();
 }
 
-void Node::stop() const
+void Node::stop()
 {
   m_log.info("Stopping node");
 
   m_websocket_server.stop();
   m_http_server.stop();
+
+  {
+    std::scoped_lock lock { m_producer_mtx };
+
+    m_producer_stop = true;
+  }
+
+  m_producer_cv.notify_one();
 }
 
 void Node::websocket_setup()
@@ -72,6 +134,14 @@ void Node::websocket_setup()
                              [this](json const &data)
                              { return handle_request_all_blocks(data); });
 
+  m_websocket_server.support("/request-headers",
+                             [this](json const &data)
+                             { return handle_request_headers(data); });
+
+  m_websocket_server.support("/request-blocks-range",
+                             [this](json const &data)
+                             { return handle_request_blocks_range(data); });
+
   m_websocket_server.support("/receive-latest-block",
                              [this](json const &data)
                              { return handle_receive_latest_block(data); });
@@ -84,6 +154,10 @@ void Node::websocket_setup()
   m_websocket_server.support("/receive-transaction",
                              [this](json const &data)
                              { return handle_receive_transaction(data); });
+
+  m_websocket_server.support("/receive-transactions",
+                             [this](json const &data)
+                             { return handle_receive_transactions(data); });
 #endif // TRANSACTIONS
 }
 
@@ -91,14 +165,24 @@ void Node::http_setup()
 {
   m_http_server.support("/blocks",
                         HTTPServer::method::get,
-                        [this](json const &)
-                        { return handle_blocks_get(); });
+                        [this](json const &data)
+                        { return handle_blocks_get(data); });
 
   m_http_server.support("/blocks/latest",
                         HTTPServer::method::get,
                         [this](json const &)
                         { return handle_blocks_latest_get(); });
 
+  m_http_server.support("/blocks/{index}",
+                        HTTPServer::method::get,
+                        [this](json const &data)
+                        { return handle_blocks_index_get(data); });
+
+  m_http_server.support("/blocks/hash/{hash}",
+                        HTTPServer::method::get,
+                        [this](json const &data)
+                        { return handle_blocks_hash_get(data); });
+
   m_http_server.support("/blocks",
                         HTTPServer::method::post,
                         [this](json const &data)
@@ -130,6 +214,11 @@ void Node::http_setup()
                         [this](json const &data)
                         { return handle_transactions_post(data); });
 
+  m_http_server.support("/transactions/batch",
+                        HTTPServer::method::post,
+                        [this](json const &data)
+                        { return handle_transactions_batch_post(data); });
+
   m_http_server.support("/transactions/unconfirmed",
                         HTTPServer::method::get,
                         [this](json const &)
@@ -139,86 +228,186 @@ void Node::http_setup()
                         HTTPServer::method::get,
                         [this](json const &)
                         { return handle_transactions_unspent_get(); });
+
+  m_http_server.support("/transactions/{hash}",
+                        HTTPServer::method::get,
+                        [this](json const &data)
+                        { return handle_transactions_get(data); });
+
+  m_http_server.support("/addresses/{address}/transactions",
+                        HTTPServer::method::get,
+                        [this](json const &data)
+                        { return handle_addresses_transactions_get(data); });
+#else
+  m_http_server.support("/entries",
+                        HTTPServer::method::post,
+                        [this](json const &data)
+                        { return handle_entries_post(data); });
+
+  m_http_server.support("/entries/{id}",
+                        HTTPServer::method::get,
+                        [this](json const &data)
+                        { return handle_entries_get(data); });
 #endif // TRANSACTIONS
 }
 
-void Node::blockchain_setup()
+void Node::blockchain_setup(uint64_t fork)
 {
 #ifdef TRANSACTIONS
-    m_transaction_unspent_outputs.clear();
+    if (fork == 0)
+      m_chain_state.clear();
+    else
+      m_chain_state.disconnect(fork);
 
-    for (auto const &block : m_blockchain.all_blocks()) {
-      for (auto const &transaction : block.data().get())
-        m_transaction_unspent_outputs.update(transaction);
-    }
+    auto snapshot { m_blockchain.snapshot() };
 
-    m_transaction_unconfirmed_pool.clear();
+    for (uint64_t i { fork }; i < snapshot->length(); ++i)
+      m_chain_state.connect(snapshot->block(i).data(), i);
 #endif // TRANSACTIONS
 }
 
-std::pair<HTTPServer::status, json> Node::handle_blocks_get() const
+void Node::block_store_setup(uint64_t first)
+{
+  if (!m_block_store)
+    return;
+
+  // Blocks before 'first' are known to be stored already.
+  first = std::min<uint64_t>(first, m_block_store->size());
+
+  auto blocks { m_blockchain.blocks(first, m_blockchain.length()) };
+
+  // Only rewrite the part of the store that differs from the blockchain.
+  std::size_t common { 0 };
+  while (common < std::min(blocks.size(), m_block_store->size() - first) &&
+         m_block_store->hash(first + common) == blocks[common].hash()) {
+    ++common;
+  }
+
+  if (first + common < m_block_store->size())
+    m_log.info("Dropping {} blocks from block store", m_block_store->size() - first - common);
+
+  m_block_store->truncate(first + common);
+
+  for (std::size_t i { common }; i < blocks.size(); ++i)
+    m_block_store->append(blocks[i]);
+
+  m_block_store->sync();
+}
+
+std::pair<HTTPServer::status, json> Node::handle_blocks_get(json const &data) const
 {
   m_log.info("Running 'GET /blocks' handler");
 
-  json answer = m_blockchain.to_json();
+  static constexpr std::size_t LIMIT_MAX { 1000 };
 
-  return { HTTPServer::status::ok, answer };
+  // Without a range, the full blockchain is returned.
+  if (!data.contains("from") && !data.contains("to"))
+    return { HTTPServer::status::ok, m_blockchain.blocks_to_json(0, m_blockchain.length()) };
+
+  uint64_t from { 0 };
+  uint64_t to { m_blockchain.length() };
+
+  try {
+    if (data.contains("from") && !data["from"].get<std::string>().empty())
+      from = std::stoull(data["from"].get<std::string>());
+
+    if (data.contains("to") && !data["to"].get<std::string>().empty())
+      to = std::stoull(data["to"].get<std::string>());
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /blocks' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  // Written to not overflow for 'from' close to the largest integer.
+  if (to > from)
+    to = from + std::min<uint64_t>(to - from, LIMIT_MAX);
+
+  return { HTTPServer::status::ok, m_blockchain.blocks_to_json(from, to) };
 }
 
 std::pair<HTTPServer::status, json> Node::handle_blocks_latest_get() const
 {
   m_log.info("Running 'GET /blocks/latest' handler");
 
-  json answer;
-  if (!m_blockchain.empty())
-    answer = m_blockchain.latest_block().to_json();
-
-  return { HTTPServer::status::ok, answer };
+  return { HTTPServer::status::ok, m_blockchain.latest_block_to_json() };
 }
 
-std::pair<HTTPServer::status, json> Node::handle_blocks_post(json const &data)
+std::pair<HTTPServer::status, json> Node::handle_blocks_index_get(json const &data) const
 {
-  m_log.info("Running 'POST /blocks' handler");
+  m_log.info("Running 'GET /blocks/{index}' handler");
+
+  uint64_t index;
 
   try {
-#ifdef TRANSACTIONS
+    index = std::stoull(data["index"].get<std::string>());
 
-    auto reward_address { data["address"].get<std::string>() };
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /blocks/{index}' request: '" + data.dump() + "': " + e.what() };
 
-    std::vector<transaction> ts_;
+    m_log.error(err);
 
-    m_log.info("Assembling block from unconfirmed transaction pool");
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
 
-    ts_.push_back(transaction::reward(reward_address, m_blockchain.length()));
+  auto blocks { m_blockchain.blocks_to_json(index, index + 1) };
 
-    for (std::size_t i { 0 }; i < config().transaction_num_per_block; ++i) {
-      if (m_transaction_unconfirmed_pool.empty())
-        break;
+  if (blocks.empty())
+    throw HTTPError { HTTPServer::status::not_found, "Block not found" };
 
-      ts_.push_back(m_transaction_unconfirmed_pool.next());
-    }
+  return { HTTPServer::status::ok, blocks[0] };
+}
 
-    transaction_list ts { ts_.begin(), ts_.end() };
+std::pair<HTTPServer::status, json> Node::handle_blocks_hash_get(json const &data) const
+{
+  m_log.info("Running 'GET /blocks/hash/{hash}' handler");
 
-    m_log.info("Constructing block");
+  Digest hash;
+
+  try {
+    hash = Digest::from_string(data["hash"].get<std::string>());
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /blocks/hash/{hash}' request: '" + data.dump() + "': " + e.what() };
 
-    m_blockchain.construct_next_block(ts);
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
 
-    m_log.info("Updating unspent transaction outputs");
+  auto answer { m_blockchain.block_to_json(hash) };
+
+  if (answer.is_null())
+    throw HTTPError { HTTPServer::status::not_found, "Block not found" };
+
+  return { HTTPServer::status::ok, answer };
+}
 
-    for (auto const &t : ts.get())
-      m_transaction_unspent_outputs.update(t);
+std::pair<HTTPServer::status, json> Node::handle_blocks_post(json const &data)
+{
+  m_log.info("Running 'POST /blocks' handler");
 
-    m_log.info("Updating unconfirmed transaction pool");
+  try {
+#ifdef TRANSACTIONS
 
-    m_transaction_unconfirmed_pool.prune(m_transaction_unspent_outputs.get());
+    produce_block(data["address"].get<std::string>());
 
 #else
 
+    std::scoped_lock lock { m_connect_mtx };
+
     auto d { block::data_type::from_json(data) };
 
     m_blockchain.construct_next_block(d);
 
+    store_latest_block();
+
 #endif // TRANSACTIONS
 
     m_log.debug("Constructed next block: '{}'",
@@ -249,7 +438,7 @@ std::pair<HTTPServer::status, json> Node::handle_blocks_persist_post(json const
     if (!f)
       throw std::runtime_error("failed to open file");
 
-    f << m_blockchain.to_json().dump() << std::endl;
+    f << json_dump(m_blockchain.blocks_to_json(0, m_blockchain.length())) << std::endl;
     if (!f)
       throw std::runtime_error("failed to write to file");
 
@@ -305,6 +494,43 @@ std::pair<HTTPServer::status, json> Node::handle_peers_post(json const &data)
 
 #ifdef TRANSACTIONS
 
+std::pair<HTTPServer::status, json> Node::handle_transactions_get(json const &data) const
+{
+  m_log.info("Running 'GET /transactions/{hash}' handler");
+
+  Digest hash;
+
+  try {
+    hash = Digest::from_string(data["hash"].get<std::string>());
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /transactions/{hash}' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  json answer;
+
+  if (auto record { m_blockchain.find_item(hash) }) {
+    answer["transaction"] = record->value.to_json();
+    answer["block_index"] = record->block_index;
+    answer["position"] = record->position;
+    answer["confirmations"] = record->confirmations;
+
+  } else if (auto t { m_chain_state.find_unconfirmed(hash) }) {
+    answer["transaction"] = t->to_json();
+    answer["confirmations"] = 0;
+
+  } else {
+    throw HTTPError { HTTPServer::status::not_found, "Transaction not found" };
+  }
+
+  return { HTTPServer::status::ok, answer };
+}
+
 std::pair<HTTPServer::status, json> Node::handle_transactions_latest_get()
 {
   m_log.info("Running 'GET /transactions/latest' handler");
@@ -323,13 +549,12 @@ std::pair<HTTPServer::status, json> Node::handle_transactions_post(json const &d
   try {
     auto t { transaction::from_json(data) };
 
-    m_log.debug("Linking transaction with unspent transaction outputs");
-
-    t.update_unspent_outputs(m_transaction_unspent_outputs.get());
-
     m_log.info("Adding transaction to unconfirmed transaction pool");
 
-    m_transaction_unconfirmed_pool.add(std::move(t));
+    m_chain_state.add(t);
+
+    block_template_notify();
+    producer_notify();
 
     broadcast_transaction(t);
 
@@ -345,11 +570,38 @@ std::pair<HTTPServer::status, json> Node::handle_transactions_post(json const &d
   return { HTTPServer::status::ok, {} };
 }
 
+std::pair<HTTPServer::status, json> Node::handle_transactions_batch_post(json const &data)
+{
+  m_log.info("Running 'POST /transactions/batch' handler");
+
+  json answer;
+  std::vector<transaction> added;
+
+  try {
+    answer = add_transactions(data, added);
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'POST /transactions/batch' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  m_log.info("Added {} out of {} transactions", added.size(), data.size());
+
+  if (!added.empty())
+    broadcast_transactions(added);
+
+  return { HTTPServer::status::ok, answer };
+}
+
 std::pair<HTTPServer::status, json> Node::handle_transactions_unconfirmed_get()
 {
   m_log.info("Running 'GET /transactions/unconfirmed' handler");
 
-  json answer = m_transaction_unconfirmed_pool.to_json();
+  json answer = m_chain_state.unconfirmed_pool_to_json();
 
   return { HTTPServer::status::ok, answer };
 }
@@ -358,7 +610,72 @@ std::pair<HTTPServer::status, json> Node::handle_transactions_unspent_get() cons
 {
   m_log.info("Running 'GET /transactions/unspent' handler");
 
-  json answer = m_transaction_unspent_outputs.to_json();
+  json answer = m_chain_state.unspent_outputs_to_json();
+
+  return { HTTPServer::status::ok, answer };
+}
+
+std::pair<HTTPServer::status, json> Node::handle_addresses_transactions_get(json const &data) const
+{
+  m_log.info("Running 'GET /addresses/{address}/transactions' handler");
+
+  static constexpr std::size_t LIMIT_DEFAULT { 100 };
+  static constexpr std::size_t LIMIT_MAX { 1000 };
+
+  if (!config().transaction_address_index)
+    throw HTTPError { HTTPServer::status::not_implemented, "Address index disabled" };
+
+  std::string address;
+  std::size_t cursor { 0 };
+  std::size_t limit { LIMIT_DEFAULT };
+
+  try {
+    address = data["address"].get<std::string>();
+
+    if (data.contains("cursor") && !data["cursor"].get<std::string>().empty())
+      cursor = std::stoull(data["cursor"].get<std::string>());
+
+    if (data.contains("limit") && !data["limit"].get<std::string>().empty())
+      limit = std::min<std::size_t>(std::stoull(data["limit"].get<std::string>()), LIMIT_MAX);
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /addresses/{address}/transactions' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  // Request one more entry than needed to find out whether there are more.
+  auto entries { m_chain_state.address_transactions(address, cursor, limit + 1) };
+
+  bool more { entries.size() > limit };
+  if (more)
+    entries.pop_back();
+
+  json answer;
+
+  answer["transactions"] = json::array();
+
+  for (auto const &entry : entries) {
+    auto record { m_blockchain.find_item(entry.hash) };
+    if (!record)
+      continue;
+
+    json j;
+    j["transaction"] = record->value.to_json();
+    j["block_index"] = record->block_index;
+    j["position"] = record->position;
+    j["confirmations"] = record->confirmations;
+
+    answer["transactions"].push_back(j);
+  }
+
+  if (more)
+    answer["next_cursor"] = std::to_string(cursor + entries.size());
+  else
+    answer["next_cursor"] = nullptr;
 
   return { HTTPServer::status::ok, answer };
 }
@@ -369,7 +686,9 @@ json Node::handle_request_latest_block(json const &data) const
 {
   m_log.info("Running 'request_latest_block' handler");
 
-  if (m_blockchain.empty()) {
+  auto latest { m_blockchain.latest_block_to_json() };
+
+  if (latest.is_null()) {
     std::string err { "Blockchain is empty" };
 
     m_log.error(err);
@@ -378,7 +697,7 @@ json Node::handle_request_latest_block(json const &data) const
   }
 
   json answer;
-  answer["block"] = m_blockchain.latest_block().to_json();
+  answer["block"] = std::move(latest);
   // XXX Client might see different host.
   answer["origin"]["host"] = m_websocket_server.host();
   answer["origin"]["port"] = m_websocket_server.port();
@@ -390,8 +709,27 @@ json Node::handle_request_all_blocks(json const &data) const
 {
   m_log.info("Running 'request_all_blocks' handler");
 
+  // Only send the blocks following the latest block the requesting node
+  // already knows, which is found via the block locator in its request.
+  uint64_t fork { 0 };
+
+  try {
+    if (data.contains("locator"))
+      fork = find_fork(data["locator"]);
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'request_all_blocks' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw WebSocketError(err);
+  }
+
   json answer;
-  answer["blockchain"] = m_blockchain.to_json();
+  answer["fork"] = fork;
+  answer["blocks"] = m_blockchain.blocks_to_json(fork, m_blockchain.length());
+
   // XXX Client might see different host.
   answer["origin"]["host"] = m_websocket_server.host();
   answer["origin"]["port"] = m_websocket_server.port();
@@ -399,6 +737,60 @@ json Node::handle_request_all_blocks(json const &data) const
   return answer;
 }
 
+json Node::handle_request_headers(json const &data) const
+{
+  m_log.info("Running 'request_headers' handler");
+
+  uint64_t fork;
+
+  try {
+    fork = find_fork(data["locator"]);
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'request_headers' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw WebSocketError(err);
+  }
+
+  json answer;
+  answer["fork"] = fork;
+  answer["headers"] = json::array();
+  for (auto const &h : m_blockchain.headers(fork, fork + config().sync_headers_max))
+    answer["headers"].push_back(h.to_json());
+
+  return answer;
+}
+
+json Node::handle_request_blocks_range(json const &data) const
+{
+  m_log.info("Running 'request_blocks_range' handler");
+
+  uint64_t from, to;
+
+  try {
+    from = data["from"].get<uint64_t>();
+    to = data["to"].get<uint64_t>();
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'request_blocks_range' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw WebSocketError(err);
+  }
+
+  to = std::min(to, from + config().sync_window_size);
+
+  json answer;
+  answer["blocks"] = m_blockchain.blocks_to_json(from, to);
+
+  return answer;
+}
+
 json Node::handle_receive_latest_block(json const &data)
 {
   m_log.info("Running 'receive_latest_block' handler");
@@ -408,6 +800,8 @@ json Node::handle_receive_latest_block(json const &data)
   else
     m_log.info("Current latest block: '{}'", m_blockchain.latest_block().to_json().dump());
 
+  std::scoped_lock lock { m_connect_mtx };
+
   std::unique_ptr<block> b;
 
   try {
@@ -415,26 +809,31 @@ json Node::handle_receive_latest_block(json const &data)
 
     m_log.debug("Received block: '{}'", b->to_json().dump());
 
-#ifdef TRANSACTIONS
-    auto &ts { b->data() };
+    // Blocks are checked in order of increasing cost so that stale, duplicate
+    // and out-of-order blocks are rejected before their data is validated.
+    if (m_blockchain.contains(*b)) {
+      m_log.info("Ignoring block (already known)");
+      return {};
+    }
 
-    m_log.debug("Linking transactions with unspent transaction outputs");
+    if (b->index() < m_blockchain.length()) {
+      m_log.info("Ignoring block (not a successor)");
+      return {};
+    }
 
-    for (auto &t : ts.get())
-      t.update_unspent_outputs(m_transaction_unspent_outputs.get());
-#endif // TRANSACTIONS
+    if (b->index() > m_blockchain.length()) {
+      // The missing blocks are validated while synchronizing, only make sure
+      // that this block was actually mined before that.
+      auto [b_valid, b_error] = b->valid_header();
 
-    auto [b_valid, b_error] = b->valid();
+      if (!b_valid) {
+        std::string err { "Invalid block: '" + b->to_json().dump() + "': " + b_error };
 
-    if (!b_valid) {
-      std::string err { "Invalid block: '" + b->to_json().dump() + "': " + b_error };
+        m_log.error(err);
 
-      m_log.error(err);
+        throw WebSocketError(err);
+      }
 
-      throw WebSocketError(err);
-    }
-
-    if (b->index() > m_blockchain.length()) {
       std::string host;
       uint16_t port;
 
@@ -458,25 +857,39 @@ json Node::handle_receive_latest_block(json const &data)
 
       m_log.info("Peer is {}:{}", host, port);
 
-      detach(&Node::request_all_blocks, peer_id);
+      detach(&Node::sync, peer_id);
 
-    } else if (b->index() == m_blockchain.length()) {
-      if ((m_blockchain.empty() && b->is_genesis()) ||
-          (!m_blockchain.empty() && b->is_successor_of(m_blockchain.latest_block()))) {
+      return {};
+    }
 
-        m_log.info("Appending next block");
+    if (!(m_blockchain.empty() && b->is_genesis()) &&
+        !(!m_blockchain.empty() && b->is_successor_of(m_blockchain.latest_block()))) {
+      m_log.info("Ignoring block (not a valid successor)");
+      return {};
+    }
 
-        m_blockchain.append_next_block(*b);
+    m_log.info("Appending next block");
 
-      } else {
-        m_log.info("Ignoring block (not a valid successor)");
-        return {};
-      }
+#ifdef TRANSACTIONS
+    // Signatures are only verified once the transactions' structure has been
+    // found to be valid.
+    m_blockchain.append_next_block(*b, [this](auto &ts, uint64_t index) {
+      auto [valid, error] = ts.valid_stateless(index);
 
-    } else {
-      m_log.info("Ignoring block (not a successor)");
-      return {};
-    }
+      if (!valid)
+        return std::make_pair(false, error);
+
+      m_log.debug("Linking transactions with unspent transaction outputs");
+
+      m_chain_state.link(ts);
+
+      return ts.valid_inputs();
+    });
+#else
+    m_blockchain.append_next_block(*b);
+#endif // TRANSACTIONS
+
+    store_latest_block();
 
   } catch (std::exception const &e) {
     std::string err {
@@ -489,19 +902,11 @@ json Node::handle_receive_latest_block(json const &data)
 
 #ifdef TRANSACTIONS
 
-  auto const &ts { b->data() };
-
-  m_log.info("Updating unspent transaction outputs");
+  m_log.info("Updating unspent transaction outputs and unconfirmed transaction pool");
 
-  for (auto const &t : ts.get())
-    m_transaction_unspent_outputs.update(t);
+  m_chain_state.connect(b->data(), b->index());
 
-  m_log.info("Updating unconfirmed transaction pool");
-
-  for (auto const &t : ts.get())
-    m_transaction_unconfirmed_pool.remove(t);
-
-  m_transaction_unconfirmed_pool.prune(m_transaction_unspent_outputs.get());
+  block_template_notify();
 
 #endif // TRANSACTIONS
 
@@ -512,22 +917,14 @@ json Node::handle_receive_all_blocks(json const &data)
 {
   m_log.info("Running 'receive_all_blocks' handler");
 
-  std::unique_ptr<blockchain> bc;
+  uint64_t fork;
+  std::vector<block> blocks;
 
   try {
-    bc = std::make_unique<blockchain>(blockchain::from_json(data["blockchain"]));
-
-    auto [bc_valid, bc_error] = bc->valid();
-
-    if (!bc_valid) {
-      std::string err { "Invalid blockchain: '" + bc->to_json().dump() + "': " + bc_error };
-
-      m_log.error(err);
-
-      throw WebSocketError(err);
-    }
+    fork = data["fork"].get<uint64_t>();
 
-    m_log.debug("Received blockchain: '{}'", bc->to_json().dump());
+    for (auto const &j_block : data["blocks"])
+      blocks.push_back(block::from_json(j_block));
 
   } catch (std::exception const &e) {
     std::string err {
@@ -538,12 +935,17 @@ json Node::handle_receive_all_blocks(json const &data)
     throw WebSocketError(err);
   }
 
-  if (*bc > m_blockchain) {
-    m_log.info("Replacing current blockchain");
+  m_log.debug("Received {} blocks starting at block {}", blocks.size(), fork);
 
-    m_blockchain = std::move(*bc);
+  try {
+    replace_blocks(fork, std::move(blocks));
+
+  } catch (std::exception const &e) {
+    std::string err { fmt::format("Invalid blocks starting at block {}: {}", fork, e.what()) };
 
-    blockchain_setup();
+    m_log.error(err);
+
+    throw WebSocketError(err);
   }
 
   return {};
@@ -560,8 +962,6 @@ json Node::handle_receive_transaction(json const &data)
   try {
     t = std::make_unique<transaction>(transaction::from_json(data));
 
-    t->update_unspent_outputs(m_transaction_unspent_outputs.get());
-
     m_log.debug("Received transaction: '{}'", t->to_json().dump());
 
   } catch (std::exception const &e) {
@@ -576,7 +976,11 @@ json Node::handle_receive_transaction(json const &data)
   m_log.info("Adding transaction to unconfirmed transaction pool");
 
   try {
-    m_transaction_unconfirmed_pool.add(*t);
+    m_chain_state.add(std::move(*t));
+
+    block_template_notify();
+    producer_notify();
+
   } catch (std::exception const &e) {
     m_log.error("Failed to add transaction to unconfirmed transaction pool: {}", e.what());
   }
@@ -584,15 +988,477 @@ json Node::handle_receive_transaction(json const &data)
   return {};
 }
 
+json Node::handle_receive_transactions(json const &data)
+{
+  m_log.info("Running 'receive_transactions' handler");
+
+  std::vector<transaction> added;
+
+  try {
+    auto answer { add_transactions(data, added) };
+
+    for (auto const &result : answer) {
+      if (result["status"] != "ok")
+        m_log.error("Failed to add transaction to unconfirmed transaction pool: {}",
+                    result["error"].get<std::string>());
+    }
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'receive_transactions' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw WebSocketError(err);
+  }
+
+  return {};
+}
+
+json Node::add_transactions(json const &data, std::vector<transaction> &added)
+{
+  if (!data.is_array())
+    throw std::invalid_argument("expected an array of transactions");
+
+  std::vector<std::optional<transaction>> ts(data.size());
+  std::vector<std::string> errors(data.size());
+
+  ThreadPool::instance().parallel_for(data.size(), [&](std::size_t i){
+    try {
+      ts[i] = transaction::from_json(data[i]);
+    } catch (std::exception const &e) {
+      errors[i] = e.what();
+    }
+  });
+
+  // Transactions spending outputs of other transactions in the same batch
+  // are added one after another once all other transactions have been added
+  // in parallel.
+  std::unordered_set<Digest> hashes;
+
+  for (auto const &t : ts) {
+    if (t)
+      hashes.insert(t->hash());
+  }
+
+  std::vector<std::size_t> independent, dependent;
+
+  for (std::size_t i { 0 }; i < ts.size(); ++i) {
+    if (!ts[i])
+      continue;
+
+    auto const &inputs { ts[i]->inputs() };
+
+    bool depends { std::any_of(inputs.begin(), inputs.end(),
+                               [&hashes](auto const &txi)
+                               { return hashes.count(txi.output_hash) > 0; }) };
+
+    (depends ? dependent : independent).push_back(i);
+  }
+
+  auto add = [&](std::size_t i){
+    try {
+      m_chain_state.add(*ts[i]);
+    } catch (std::exception const &e) {
+      errors[i] = e.what();
+    }
+  };
+
+  ThreadPool::instance().parallel_for(independent.size(),
+                                      [&](std::size_t i){ add(independent[i]); });
+
+  for (auto i : dependent)
+    add(i);
+
+  json answer = json::array();
+
+  for (std::size_t i { 0 }; i < ts.size(); ++i) {
+    json result;
+
+    if (errors[i].empty()) {
+      result["status"] = "ok";
+      result["hash"] = ts[i]->hash().to_string();
+
+      added.push_back(std::move(*ts[i]));
+
+    } else {
+      result["status"] = "not ok";
+      result["error"] = errors[i];
+    }
+
+    answer.push_back(result);
+  }
+
+  if (!added.empty()) {
+    block_template_notify();
+    producer_notify();
+  }
+
+  return answer;
+}
+
+bool Node::produce_block(std::string const &reward_address, bool allow_empty)
+{
+  {
+    std::scoped_lock lock { m_connect_mtx };
+
+    auto next { block_template_next() };
+
+    auto index { next.index };
+
+    std::vector<transaction> ts_;
+
+    ts_.push_back(transaction::reward(reward_address, index));
+
+    bool validated { false };
+
+    {
+      std::scoped_lock lock_block_template { m_block_template_mtx };
+
+      if (m_block_template && m_block_template->same_parent(next)) {
+        m_log.info("Assembling block from block template");
+
+        ts_.insert(ts_.end(), m_block_template->ts.begin(), m_block_template->ts.end());
+
+        validated = true;
+      }
+    }
+
+    if (!validated) {
+      m_log.info("Assembling block from unconfirmed transaction pool");
+
+      for (auto &t : m_chain_state.select(config().transaction_num_per_block, index))
+        ts_.push_back(std::move(t));
+    }
+
+    if (ts_.size() == 1 && !allow_empty)
+      return false;
+
+    transaction_list ts { ts_.begin(), ts_.end() };
+
+    m_log.info("Constructing block");
+
+    m_blockchain.construct_next_block(ts, validated);
+
+    store_latest_block();
+
+    m_log.info("Updating unspent transaction outputs and unconfirmed transaction pool");
+
+    m_chain_state.connect(ts, index);
+  }
+
+  block_template_notify();
+
+  return true;
+}
+
+Node::BlockTemplate Node::block_template_next() const
+{
+  auto snapshot { m_blockchain.snapshot() };
+
+  BlockTemplate block_template { snapshot->length(), {}, {} };
+
+  if (!snapshot->empty())
+    block_template.hash_prev = snapshot->latest_block().hash();
+
+  return block_template;
+}
+
+void Node::block_template_notify()
+{
+  // Coalesce notifications arriving while a refresh is pending.
+  if (m_block_template_refresh.exchange(true))
+    return;
+
+  detach(&Node::block_template_refresh);
+}
+
+void Node::block_template_refresh()
+{
+  // Transactions are selected and validated without holding the template's
+  // lock, so that block assembly never waits for a refresh.
+  std::scoped_lock lock_refresh { m_block_template_refresh_mtx };
+
+  m_block_template_refresh = false;
+
+  auto block_template { block_template_next() };
+
+  auto ts { m_chain_state.select(config().transaction_num_per_block, block_template.index) };
+
+  // Only validate transactions that were not already part of the template.
+  std::unordered_set<Digest> validated;
+
+  {
+    std::scoped_lock lock { m_block_template_mtx };
+
+    if (m_block_template && m_block_template->same_parent(block_template)) {
+      for (auto const &t : m_block_template->ts)
+        validated.insert(t.hash());
+    }
+  }
+
+  std::vector<char> valid(ts.size());
+
+  ThreadPool::instance().parallel_for(ts.size(), [&](std::size_t i){
+    valid[i] = validated.contains(ts[i].hash()) || ts[i].valid().first;
+  });
+
+  // Drop invalid transactions along with those spending their outputs.
+  std::unordered_set<Digest> dropped;
+
+  for (std::size_t i { 0 }; i < ts.size(); ++i) {
+    auto const &inputs { ts[i].inputs() };
+
+    bool drop { !valid[i] || std::any_of(
+      inputs.begin(),
+      inputs.end(),
+      [&](auto const &txi){ return dropped.contains(txi.output_hash); }) };
+
+    if (drop)
+      dropped.insert(ts[i].hash());
+    else
+      block_template.ts.push_back(std::move(ts[i]));
+  }
+
+  if (!dropped.empty())
+    m_log.warning("Dropped {} invalid transactions from block template", dropped.size());
+
+  std::scoped_lock lock { m_block_template_mtx };
+
+  // A block connected or replaced in the meantime triggers another refresh.
+  if (!block_template_next().same_parent(block_template))
+    return;
+
+  m_block_template = std::move(block_template);
+}
+
+#else
+
+std::pair<HTTPServer::status, json> Node::handle_entries_get(json const &data) const
+{
+  m_log.info("Running 'GET /entries/{id}' handler");
+
+  Digest hash;
+
+  try {
+    hash = Digest::from_string(data["id"].get<std::string>());
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'GET /entries/{id}' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  json answer;
+
+  if (auto record { m_blockchain.find_item(hash) }) {
+    answer["status"] = "confirmed";
+    answer["entry"] = record->value;
+    answer["block_index"] = record->block_index;
+    answer["position"] = record->position;
+    answer["confirmations"] = record->confirmations;
+
+  } else {
+    std::scoped_lock lock { m_entries_mtx };
+
+    if (!m_entries_pending_hashes.contains(hash))
+      throw HTTPError { HTTPServer::status::not_found, "Entry not found" };
+
+    answer["status"] = "pending";
+  }
+
+  return { HTTPServer::status::ok, answer };
+}
+
+std::pair<HTTPServer::status, json> Node::handle_entries_post(json const &data)
+{
+  m_log.info("Running 'POST /entries' handler");
+
+  std::vector<std::string> entries;
+
+  try {
+    entries = Text::from_json(data).get();
+
+  } catch (std::exception const &e) {
+    std::string err {
+      "Malformed 'POST /entries' request: '" + data.dump() + "': " + e.what() };
+
+    m_log.error(err);
+
+    throw HTTPError { HTTPServer::status::bad_request, err };
+  }
+
+  json answer = json::array();
+
+  {
+    std::scoped_lock lock { m_entries_mtx };
+
+    for (auto &entry : entries) {
+      auto salt { fmt::format("{}:{}", m_uuid.to_string(), m_entries_sequence++) };
+      auto hash { Text::hash(entry, salt) };
+
+      answer.push_back({ { "id", hash.to_string() } });
+
+      m_entries_pending_hashes.insert(hash);
+      m_entries_pending.push_back({ hash, std::move(entry), std::move(salt) });
+    }
+  }
+
+  producer_notify();
+
+  if (!data.is_array())
+    return { HTTPServer::status::ok, answer[0] };
+
+  return { HTTPServer::status::ok, answer };
+}
+
+bool Node::produce_block()
+{
+  std::vector<PendingEntry> entries;
+
+  {
+    std::scoped_lock lock { m_entries_mtx };
+
+    auto n { std::min(m_entries_pending.size(), producer_fill_threshold()) };
+
+    std::move(m_entries_pending.begin(),
+              m_entries_pending.begin() + n,
+              std::back_inserter(entries));
+
+    m_entries_pending.erase(m_entries_pending.begin(), m_entries_pending.begin() + n);
+  }
+
+  if (entries.empty())
+    return false;
+
+  std::vector<std::string> texts;
+  std::vector<std::string> salts;
+
+  for (auto const &entry : entries) {
+    texts.push_back(entry.text);
+    salts.push_back(entry.salt);
+  }
+
+  try {
+    std::scoped_lock lock { m_connect_mtx };
+
+    m_log.info("Constructing block from {} entries", texts.size());
+
+    m_blockchain.construct_next_block(Text { std::move(texts), std::move(salts) });
+
+    store_latest_block();
+
+  } catch (...) {
+    // Return the entries to the front of the buffer.
+    std::scoped_lock lock { m_entries_mtx };
+
+    m_entries_pending.insert(m_entries_pending.begin(), entries.begin(), entries.end());
+
+    throw;
+  }
+
+  std::scoped_lock lock { m_entries_mtx };
+
+  for (auto const &entry : entries)
+    m_entries_pending_hashes.erase(entry.hash);
+
+  return true;
+}
+
 #endif // TRANSACTIONS
 
+void Node::producer_run()
+{
+  std::unique_lock lock { m_producer_mtx };
+
+  while (!m_producer_stop) {
+#ifdef TRANSACTIONS
+    // Pooled transactions that can't go into the next block (yet) don't
+    // count, otherwise they would trigger blocks without any transactions.
+    auto pending { m_chain_state.select(config().transaction_num_per_block,
+                                        m_blockchain.length()).size() };
+#else
+    std::size_t pending;
+
+    {
+      std::scoped_lock lock_entries { m_entries_mtx };
+
+      pending = m_entries_pending.size();
+    }
+#endif // TRANSACTIONS
+
+    if (pending == 0) {
+      m_producer_deadline.reset();
+
+    } else if (pending >= producer_fill_threshold() ||
+               (m_producer_deadline && clock::now() >= *m_producer_deadline)) {
+
+      lock.unlock();
+
+      m_log.info("Producing block for {} pending items", pending);
+
+      bool failed { false };
+
+      try {
+#ifdef TRANSACTIONS
+        bool produced { produce_block(config().producer_reward_address, false) };
+#else
+        bool produced { produce_block() };
+#endif // TRANSACTIONS
+
+        if (produced)
+          broadcast_latest_block();
+
+      } catch (std::exception const &e) {
+        m_log.error("Failed to produce block: {}", e.what());
+
+        failed = true;
+      }
+
+      lock.lock();
+
+      // Items left over get a fresh deadline.
+      m_producer_deadline = clock::now() + producer_latency_max();
+
+      // Don't retry a failed block before the deadline.
+      if (failed)
+        m_producer_cv.wait_until(lock, *m_producer_deadline, [this]{ return m_producer_stop; });
+
+      continue;
+    }
+
+    if (m_producer_deadline)
+      m_producer_cv.wait_until(lock, *m_producer_deadline);
+    else
+      m_producer_cv.wait(lock);
+  }
+}
+
+void Node::producer_notify()
+{
+  if (!producer_enabled())
+    return;
+
+  {
+    std::scoped_lock lock { m_producer_mtx };
+
+    if (!m_producer_deadline)
+      m_producer_deadline = clock::now() + producer_latency_max();
+  }
+
+  m_producer_cv.notify_one();
+}
+
 void Node::broadcast_latest_block()
 {
   m_log.info("Broadcasting latest block");
 
   json request;
   request["target"] = "/receive-latest-block";
-  request["data"]["block"] = m_blockchain.latest_block().to_json();
+  request["data"]["block"] = m_blockchain.latest_block_to_json();
   // XXX Client might see different host.
   request["data"]["origin"]["host"] = m_websocket_server.host();
   request["data"]["origin"]["port"] = m_websocket_server.port();
@@ -632,27 +1498,401 @@ void Node::request_latest_block(std::size_t peer_id)
     });
 }
 
-void Node::request_all_blocks(std::size_t peer_id)
+void Node::sync(std::size_t peer_id)
+{
+  std::unique_lock sync_lock { m_sync_mtx, std::try_to_lock };
+
+  if (!sync_lock) {
+    m_log.info("Already synchronizing");
+    return;
+  }
+
+  m_log.info("Synchronizing with peer {}", peer_id);
+
+  // Each round downloads at most sync_headers_total_max blocks, the next one
+  // continues from the new end of the blockchain.
+  while (sync_round(peer_id)) {}
+}
+
+// Returns whether blocks were replaced and the peer may have further blocks.
+bool Node::sync_round(std::size_t peer_id)
 {
-  m_log.info("Requesting all blocks");
+  // Headers are small, so they are requested from a single peer, in chunks
+  // that each continue where the last one ended. Each chunk is validated as
+  // soon as it arrives.
+  uint64_t fork { 0 };
+  std::vector<block_header> headers;
+
+  std::size_t received { 0 };
+  bool truncated { false };
 
   json request;
-  request["target"] = "/request-all-blocks";
+  request["target"] = "/request-headers";
+  request["data"]["locator"] = block_locator();
 
-  m_websocket_peers.send(
-    peer_id,
-    request,
-    [this](bool success, std::string const &answer)
-    {
-      if (success) {
-        try {
-          handle_receive_all_blocks(json::parse(answer));
-        } catch (...) {}
+  try {
+    for (bool first_chunk { true };; first_chunk = false) {
+      auto answer { sync_request(peer_id, request) };
 
-      } else {
-        m_log.error("Requesting all blocks failed");
+      if (!answer) {
+        m_log.error("Requesting block headers failed");
+        return false;
       }
-    });
+
+      auto answer_fork { (*answer)["fork"].get<uint64_t>() };
+
+      if (first_chunk)
+        fork = answer_fork;
+      else if (answer_fork != fork + headers.size())
+        throw std::runtime_error("block headers not connected");
+
+      auto const &j_headers { (*answer)["headers"] };
+
+      if (j_headers.size() > config().sync_headers_max)
+        throw std::runtime_error("too many block headers");
+
+      std::vector<block_header> chunk;
+      for (auto const &j_header : j_headers)
+        chunk.push_back(block_header::from_json(j_header));
+
+      if (chunk.empty())
+        break;
+
+      received += chunk.size();
+
+      json j_locator;
+      j_locator["index"] = chunk.back().index();
+      j_locator["hash"] = chunk.back().hash().to_string();
+
+      // The peer only knows our block locator, so it may send some headers of
+      // blocks that we already have.
+      std::size_t known { 0 };
+      if (headers.empty()) {
+        while (known < chunk.size() &&
+               m_blockchain.contains(chunk[known].index(), chunk[known].hash())) {
+          ++known;
+        }
+
+        fork += known;
+      }
+
+      auto first { headers.size() };
+
+      headers.insert(headers.end(), chunk.begin() + known, chunk.end());
+
+      auto [valid, error] = m_blockchain.valid_header_chain(fork, headers, first);
+
+      if (!valid) {
+        m_log.error("Invalid block headers: {}", error);
+        return false;
+      }
+
+      if (chunk.size() < config().sync_headers_max)
+        break;
+
+      if (received >= config().sync_headers_total_max) {
+        truncated = true;
+        break;
+      }
+
+      request["data"]["locator"] = json::array({ j_locator });
+    }
+
+  } catch (std::exception const &e) {
+    m_log.error("Malformed block headers: {}", e.what());
+    return false;
+  }
+
+  if (headers.empty()) {
+    m_log.info("Blockchain already up to date");
+    return false;
+  }
+
+  if (!m_blockchain.preferable(fork, headers)) {
+    m_log.info("Ignoring block headers (blockchain not preferable)");
+    return false;
+  }
+
+  m_log.info("Downloading {} blocks starting at block {}", headers.size(), fork);
+
+  auto blocks { sync_blocks(headers) };
+
+  if (!blocks) {
+    m_log.error("Downloading blocks failed");
+    return false;
+  }
+
+  try {
+    if (!replace_blocks(fork, std::move(*blocks)))
+      return false;
+
+  } catch (std::exception const &e) {
+    m_log.error("Invalid blocks starting at block {}: {}", fork, e.what());
+    return false;
+  }
+
+  return truncated;
+}
+
+// Block bodies are downloaded in windows of consecutive blocks from all peers
+// in parallel. Each peer fetches one window at a time, a peer that stalls or
+// sends blocks not matching their headers is dropped and its window is
+// reassigned to the remaining peers.
+std::optional<std::vector<Node::block>> Node::sync_blocks(
+  std::vector<block_header> const &headers)
+{
+  auto window_size { std::max<std::size_t>(config().sync_window_size, 1) };
+
+  std::vector<std::vector<block>> windows((headers.size() + window_size - 1) / window_size);
+
+  std::deque<std::size_t> pending;
+  for (std::size_t w { 0 }; w < windows.size(); ++w)
+    pending.push_back(w);
+
+  std::size_t in_flight { 0 };
+
+  std::mutex mtx;
+  std::condition_variable cv;
+
+  auto fetch = [&](std::size_t peer_id, std::size_t w) -> std::optional<std::vector<block>>
+  {
+    auto first { w * window_size };
+    auto last { std::min(first + window_size, headers.size()) };
+
+    json request;
+    request["target"] = "/request-blocks-range";
+    request["data"]["from"] = headers[first].index();
+    request["data"]["to"] = headers[last - 1].index() + 1;
+
+    auto answer { sync_request(peer_id, request) };
+
+    if (!answer)
+      return std::nullopt;
+
+    std::vector<block> blocks;
+
+    try {
+      for (auto const &j_block : (*answer)["blocks"])
+        blocks.push_back(block::from_json(j_block));
+
+    } catch (std::exception const &) {
+      return std::nullopt;
+    }
+
+    if (blocks.size() != last - first)
+      return std::nullopt;
+
+    for (std::size_t i { 0 }; i < blocks.size(); ++i) {
+      if (blocks[i].header() != headers[first + i])
+        return std::nullopt;
+    }
+
+    return blocks;
+  };
+
+  auto work = [&](std::size_t peer_id)
+  {
+    std::unique_lock lock { mtx };
+
+    for (;;) {
+      cv.wait(lock, [&]{ return !pending.empty() || in_flight == 0; });
+
+      if (pending.empty())
+        return;
+
+      auto w { pending.front() };
+      pending.pop_front();
+
+      ++in_flight;
+
+      lock.unlock();
+
+      auto blocks { fetch(peer_id, w) };
+
+      lock.lock();
+
+      --in_flight;
+
+      if (!blocks) {
+        m_log.warning("Dropping peer {} from sync, reassigning its blocks", peer_id);
+
+        pending.push_front(w);
+        cv.notify_all();
+
+        return;
+      }
+
+      windows[w] = std::move(*blocks);
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (std::size_t peer_id { 1 }; peer_id <= m_websocket_peers.size(); ++peer_id)
+    workers.emplace_back(work, peer_id);
+
+  for (auto &worker : workers)
+    worker.join();
+
+  if (!pending.empty())
+    return std::nullopt;
+
+  std::vector<block> blocks;
+  blocks.reserve(headers.size());
+
+  for (auto &window : windows)
+    std::move(window.begin(), window.end(), std::back_inserter(blocks));
+
+  return blocks;
+}
+
+// The websocket client cancels the request if the peer does not answer
+// within sync_timeout, the connection is reestablished for the next request.
+std::optional<json> Node::sync_request(std::size_t peer_id, json request)
+{
+  std::optional<json> answer;
+
+  // Returns once the peer has answered or the request has been cancelled.
+  try {
+    m_websocket_peers.send(
+      peer_id,
+      std::move(request),
+      [&answer](bool success, std::string const &data)
+      {
+        if (!success)
+          return;
+
+        try {
+          answer = json::parse(data);
+        } catch (std::exception const &) {}
+      },
+      config().sync_timeout);
+
+  } catch (std::exception const &) {
+    return std::nullopt;
+  }
+
+  return answer;
+}
+
+// The indices and hashes of the latest blocks followed by exponentially more
+// distant ones, so that a peer can find the latest common block in few steps
+// even if the chains diverged long ago.
+json Node::block_locator() const
+{
+  json locator = json::array();
+
+  auto snapshot { m_blockchain.snapshot() };
+
+  for (uint64_t step { 1 }, index { snapshot->length() }; index > 0;) {
+    index = index > step ? index - step : 0;
+
+    auto const &b { snapshot->block(index) };
+
+    json j_block;
+    j_block["index"] = b.index();
+    j_block["hash"] = b.hash().to_string();
+
+    locator.push_back(j_block);
+
+    if (locator.size() > 10)
+      step *= 2;
+  }
+
+  return locator;
+}
+
+// Index of the block following the first block in 'locator' that is part of
+// the blockchain.
+uint64_t Node::find_fork(json const &locator) const
+{
+  for (auto const &j_block : locator) {
+    auto index { j_block["index"].get<uint64_t>() };
+    auto hash { Digest::from_string(j_block["hash"].get<std::string>()) };
+
+    if (m_blockchain.contains(index, hash))
+      return index + 1;
+  }
+
+  return 0;
+}
+
+bool Node::replace_blocks(uint64_t fork, std::vector<block> blocks)
+{
+  std::scoped_lock lock { m_connect_mtx };
+
+  // Only the blocks following the common prefix of both chains are validated.
+#ifdef TRANSACTIONS
+  // The chain state is rolled back to the point where both chains diverge
+  // and only the new blocks are connected.
+  auto make_validator = [this, &fork](auto const &, uint64_t diverged){
+    fork = diverged;
+
+    return ChainState<>::Validator { m_chain_state, diverged };
+  };
+
+  if (!m_blockchain.replace_suffix(fork, std::move(blocks), make_validator))
+    return false;
+#else
+  if (!m_blockchain.replace_suffix(fork, std::move(blocks)))
+    return false;
+#endif // TRANSACTIONS
+
+  m_log.info("Replaced current blockchain starting at block {}", fork);
+
+#ifdef TRANSACTIONS
+  {
+    std::scoped_lock lock_block_template { m_block_template_mtx };
+
+    m_block_template.reset();
+  }
+#endif // TRANSACTIONS
+
+  blockchain_setup(fork);
+
+  if (m_block_store_resync)
+    fork = std::min(fork, *m_block_store_resync);
+
+  try {
+    block_store_setup(fork);
+
+    m_block_store_resync.reset();
+
+  } catch (std::exception const &e) {
+    m_log.error("Failed to update block store: {}", e.what());
+
+    m_block_store_resync = fork;
+  }
+
+#ifdef TRANSACTIONS
+  block_template_notify();
+#endif // TRANSACTIONS
+
+  return true;
+}
+
+void Node::store_latest_block()
+{
+  if (!m_block_store)
+    return;
+
+  // The block has already been connected, failing to store it is not fatal.
+  // Appending any further blocks would place them at the wrong height though,
+  // so the store is resynchronized from the missing block onwards instead.
+  try {
+    if (m_block_store_resync)
+      block_store_setup(*m_block_store_resync);
+    else
+      m_block_store->append(m_blockchain.latest_block());
+
+    m_block_store_resync.reset();
+
+  } catch (std::exception const &e) {
+    m_log.error("Failed to store latest block: {}", e.what());
+
+    if (!m_block_store_resync)
+      m_block_store_resync = m_blockchain.length() - 1;
+  }
 }
 
 #ifdef TRANSACTIONS
@@ -677,6 +1917,29 @@ void Node::broadcast_transaction(transaction const &t)
   }
 }
 
+void Node::broadcast_transactions(std::vector<transaction> const &ts)
+{
+  m_log.info("Broadcasting {} transactions", ts.size());
+
+  json request;
+  request["target"] = "/receive-transactions";
+  request["data"] = json::array();
+
+  for (auto const &t : ts)
+    request["data"].push_back(t.to_json());
+
+  for (std::size_t peer_id { 1 }; peer_id <= m_websocket_peers.size(); ++peer_id) {
+    m_websocket_peers.send(
+      peer_id,
+      request,
+      [this](bool success, std::string const &answer)
+      {
+        if (!success)
+          m_log.error("Broadcasting transactions failed: {}", answer);
+      });
+  }
+}
+
 #endif // TRANSACTIONS
 
 } // end namespace bc
@@ -1,14 +1,20 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "format.h"
 #include "json.h"
+#include "thread_pool.h"
 #include "transaction.h"
 
 namespace bc
@@ -73,7 +79,8 @@ Transaction<KEY_PAIR, HASHER>::UTxO::to_json() const
   json j;
   j["output_hash"] = output_hash.to_string();
   j["output_index"] = output_index;
-  j["output"] = output.to_json();
+  j["output"]["amount"] = output.amount;
+  j["output"]["address"] = output.address.to_string();
 
   return j;
 }
@@ -85,53 +92,66 @@ Transaction<KEY_PAIR, HASHER>
 Transaction<KEY_PAIR, HASHER>::reward(std::string const &reward_address,
                                       std::size_t index)
 {
-  Transaction t {
-    Type::REWARD,
-    index,
-    {},
-    {},
-    { TxO { config().transaction_reward_amount, reward_address } }
-  };
+  output_vector outputs { TxO { config().transaction_reward_amount, reward_address } };
 
-  t.m_hash = t.determine_hash();
+  Transaction t { Type::REWARD, index, {}, {}, outputs };
 
-  return t;
+  return Transaction { Type::REWARD, index, t.determine_hash(), {}, std::move(outputs) };
 }
 
 template Transaction<> Transaction<>::reward(std::string const &reward_address,
                                              std::size_t index);
 
 template<typename KEY_PAIR, typename HASHER>
-json
-Transaction<KEY_PAIR, HASHER>::to_json() const
+std::size_t
+Transaction<KEY_PAIR, HASHER>::size() const
 {
-  json j;
+  std::size_t size { sizeof(Data) + hash().length() };
 
-  switch (m_type) {
-  case Type::STANDARD:
-      j["type"] = "standard";
-      break;
-  case Type::REWARD:
-      j["type"] = "reward";
-      break;
-  }
+  for (auto const &txi : inputs())
+    size += sizeof(txi) + txi.output_hash.length() + txi.signature.length();
+
+  for (auto const &txo : outputs())
+    size += sizeof(txo) + txo.address.length();
+
+  return size;
+}
+
+template std::size_t Transaction<>::size() const;
+
+template<typename KEY_PAIR, typename HASHER>
+json const &
+Transaction<KEY_PAIR, HASHER>::to_json() const
+{
+  std::call_once(m_data->serialized_once, [this]{
+    auto &j { m_data->serialized };
+
+    switch (type()) {
+    case Type::STANDARD:
+        j["type"] = "standard";
+        break;
+    case Type::REWARD:
+        j["type"] = "reward";
+        break;
+    }
 
-  j["index"] = m_index;
+    j["index"] = index();
 
-  j["hash"] = m_hash.to_string();
+    j["hash"] = hash().to_string();
 
-  j["inputs"] = json::array();
-  for (auto const &txi : m_inputs)
-    j["inputs"].push_back(txi.to_json());
+    j["inputs"] = json::array();
+    for (auto const &txi : inputs())
+      j["inputs"].push_back(txi.to_json());
 
-  j["outputs"] = json::array();
-  for (auto const &txo : m_outputs)
-    j["outputs"].push_back(txo.to_json());
+    j["outputs"] = json::array();
+    for (auto const &txo : outputs())
+      j["outputs"].push_back(txo.to_json());
+  });
 
-  return j;
+  return m_data->serialized;
 }
 
-template json Transaction<>::to_json() const;
+template json const &Transaction<>::to_json() const;
 
 template<typename KEY_PAIR, typename HASHER>
 Transaction<KEY_PAIR, HASHER>
@@ -149,83 +169,131 @@ Transaction<KEY_PAIR, HASHER>::from_json(json const &j)
 
   auto hash { Digest::from_string(json_get(j, "hash")) };
 
-  std::vector<input> inputs;
+  input_vector inputs;
   for (auto const &j_txi : json_get(j, "inputs"))
     inputs.emplace_back(input::from_json(j_txi));
 
-  std::vector<output> outputs;
+  output_vector outputs;
   for (auto const &j_txo : json_get(j, "outputs"))
     outputs.emplace_back(output::from_json(j_txo));
 
-  return Transaction { type, index, hash, inputs, outputs };
+  return Transaction { type, index, std::move(hash), std::move(inputs), std::move(outputs) };
 }
 
 template Transaction<> Transaction<>::from_json(json const &data);
 
 template<typename KEY_PAIR, typename HASHER>
 std::pair<bool, std::string>
-Transaction<KEY_PAIR, HASHER>::valid_standard() const
+Transaction<KEY_PAIR, HASHER>::valid_standard_stateless() const
 {
-  if (m_hash != determine_hash())
+  if (hash() != determine_hash())
     return { false, "invalid hash" };
 
-  std::size_t txi_sum { 0 };
+  if (inputs().empty())
+    return { false, "no inputs" };
 
-  for (std::size_t i { 0 }; i < m_inputs.size(); ++i) {
-    auto const &txi { m_inputs[i] };
+  if (outputs().empty())
+    return { false, "no outputs" };
 
-    std::string txi_address;
+  for (std::size_t i { 0 }; i < inputs().size(); ++i) {
+    for (std::size_t j { 0 }; j < i; ++j) {
+      if (inputs()[i] == inputs()[j])
+        return { false, fmt::format("input {}: duplicate of input {}", i, j) };
+    }
+  }
 
-    for (auto const &utxo : m_unspent_outputs) {
-      if (utxo.output_hash == txi.output_hash &&
-          utxo.output_index == txi.output_index) {
+  std::size_t txo_sum { 0 };
 
-        txi_address = utxo.output.address;
-        txi_sum += utxo.output.amount;
-      }
-    }
+  for (auto const &txo : outputs()) {
+    if (txo_sum + txo.amount < txo_sum)
+      return { false, "output sum overflow" };
 
-    if (txi_address.empty())
-      return { false, fmt::format("input {}: no corresponding unspent output found", i) };
+    txo_sum += txo.amount;
+  }
 
-    try {
-      typename KEY_PAIR::public_key key { txi_address };
+  return { true, "" };
+}
 
-      if (!key.verify(m_hash, txi.signature))
-        return { false, fmt::format("input {}: invalid signature", i) };
+template std::pair<bool, std::string> Transaction<>::valid_standard_stateless() const;
 
-    } catch (std::exception const &e) {
-      return { false, fmt::format("input {}: exception during signature validation: {}", i, e.what()) };
-    }
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+Transaction<KEY_PAIR, HASHER>::valid_standard_inputs(bool verify_signatures) const
+{
+  std::size_t txi_sum { 0 };
+
+  for (std::size_t i { 0 }; i < inputs().size(); ++i) {
+    auto const &txi { inputs()[i] };
+
+    auto utxo { std::find(m_unspent_outputs.begin(), m_unspent_outputs.end(), txi) };
+
+    if (utxo == m_unspent_outputs.end())
+      return { false, fmt::format("input {}: no corresponding unspent output found", i) };
+
+    if (txi_sum + utxo->output.amount < txi_sum)
+      return { false, "input sum overflow" };
+
+    txi_sum += utxo->output.amount;
   }
 
   std::size_t txo_sum { 0 };
 
-  for (auto const &txo : m_outputs)
+  for (auto const &txo : outputs())
     txo_sum += txo.amount;
 
   if (txi_sum != txo_sum)
     return { false, fmt::format("mismatched input/output sums") };
 
+  if (verify_signatures)
+    return valid_standard_signatures();
+
+  return { true, "" };
+}
+
+template std::pair<bool, std::string> Transaction<>::valid_standard_inputs(bool verify_signatures) const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+Transaction<KEY_PAIR, HASHER>::valid_standard_signatures() const
+{
+  for (std::size_t i { 0 }; i < inputs().size(); ++i) {
+    auto const &txi { inputs()[i] };
+
+    auto utxo { std::find(m_unspent_outputs.begin(), m_unspent_outputs.end(), txi) };
+
+    if (utxo == m_unspent_outputs.end())
+      return { false, fmt::format("input {}: no corresponding unspent output found", i) };
+
+    try {
+      typename KEY_PAIR::public_key key { utxo->output.address.to_string() };
+
+      if (!key.verify(hash(), txi.signature))
+        return { false, fmt::format("input {}: invalid signature", i) };
+
+    } catch (std::exception const &e) {
+      return { false, fmt::format("input {}: exception during signature validation: {}", i, e.what()) };
+    }
+  }
+
   return { true, "" };
 }
 
-template std::pair<bool, std::string> Transaction<>::valid_standard() const;
+template std::pair<bool, std::string> Transaction<>::valid_standard_signatures() const;
 
 template<typename KEY_PAIR, typename HASHER>
 std::pair<bool, std::string>
 Transaction<KEY_PAIR, HASHER>::valid_reward() const
 {
-  if (m_hash != determine_hash())
+  if (hash() != determine_hash())
     return { false, "invalid hash" };
 
-  if (!m_inputs.empty())
+  if (!inputs().empty())
     return { false, "inputs must be empty" };
 
-  if (m_outputs.size() != 1)
+  if (outputs().size() != 1)
     return { false, "more than one output" };
 
-  if (m_outputs[0].amount != config().transaction_reward_amount)
+  if (outputs()[0].amount != config().transaction_reward_amount)
     return { false, "output amount does not match reward amount" };
 
   return { true, "" };
@@ -239,13 +307,13 @@ Transaction<KEY_PAIR, HASHER>::determine_hash() const
 {
   std::stringstream ss;
 
-  ss << m_index;
+  ss << index();
 
-  for (auto const &txi : m_inputs)
+  for (auto const &txi : inputs())
     ss << txi.output_hash.to_string()
        << txi.output_index;
 
-  for (auto const &txo : m_outputs)
+  for (auto const &txo : outputs())
     ss << txo.amount
        << txo.address;
 
@@ -256,21 +324,80 @@ template Digest Transaction<>::determine_hash() const;
 
 template<typename KEY_PAIR, typename HASHER>
 std::pair<bool, std::string>
-TransactionList<KEY_PAIR, HASHER>::valid(std::size_t index) const
+TransactionList<KEY_PAIR, HASHER>::valid_stateless(std::size_t index) const
 {
   if (m_transactions.size() > config().transaction_num_per_block + 1)
     return { false, "invalid number of transactions" };
 
-  for (std::size_t i { 0 }; i < m_transactions.size(); ++i) {
+  std::vector<std::pair<bool, std::string>> results(m_transactions.size());
+
+  ThreadPool::instance().parallel_for(m_transactions.size(), [&](std::size_t i){
     auto const &t { m_transactions[i] };
 
     if (t.type() != (i == 0 ? transaction::Type::REWARD : transaction::Type::STANDARD))
-      return { false, fmt::format("transaction {}: invalid type", i) };
+      results[i] = { false, "invalid type" };
+    else if (t.index() != index)
+      results[i] = { false, fmt::format("invalid index {}", t.index()) };
+    else
+      results[i] = t.valid_stateless();
+  });
+
+  return first_invalid(results);
+}
+
+template std::pair<bool, std::string> TransactionList<>::valid_stateless(std::size_t index) const;
 
-    if (t.index() != index)
-      return { false, fmt::format("transaction {}: invalid index {}", i, t.index()) };
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+TransactionList<KEY_PAIR, HASHER>::valid_inputs(bool verify_signatures) const
+{
+  std::vector<std::pair<bool, std::string>> results(m_transactions.size());
+
+  ThreadPool::instance().parallel_for(m_transactions.size(), [&](std::size_t i){
+    results[i] = m_transactions[i].valid_inputs(verify_signatures);
+  });
+
+  return first_invalid(results);
+}
+
+template std::pair<bool, std::string> TransactionList<>::valid_inputs(bool verify_signatures) const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+TransactionList<KEY_PAIR, HASHER>::valid_signatures() const
+{
+  std::vector<std::pair<bool, std::string>> results(m_transactions.size());
 
-    auto [valid, error] = t.valid();
+  ThreadPool::instance().parallel_for(m_transactions.size(), [&](std::size_t i){
+    results[i] = m_transactions[i].valid_signatures();
+  });
+
+  return first_invalid(results);
+}
+
+template std::pair<bool, std::string> TransactionList<>::valid_signatures() const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+TransactionList<KEY_PAIR, HASHER>::valid(std::size_t index) const
+{
+  auto [valid, error] = valid_stateless(index);
+
+  if (!valid)
+    return { false, error };
+
+  return valid_inputs();
+}
+
+template std::pair<bool, std::string> TransactionList<>::valid(std::size_t index) const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::pair<bool, std::string>
+TransactionList<KEY_PAIR, HASHER>::first_invalid(
+  std::vector<std::pair<bool, std::string>> const &results)
+{
+  for (std::size_t i { 0 }; i < results.size(); ++i) {
+    auto const &[valid, error] = results[i];
 
     if (!valid)
       return { false, fmt::format("transaction {}: {}", i, error) };
@@ -279,7 +406,8 @@ TransactionList<KEY_PAIR, HASHER>::valid(std::size_t index) const
   return { true, "" };
 }
 
-template std::pair<bool, std::string> TransactionList<>::valid(std::size_t index) const;
+template std::pair<bool, std::string> TransactionList<>::first_invalid(
+  std::vector<std::pair<bool, std::string>> const &results);
 
 template<typename KEY_PAIR, typename HASHER>
 json
@@ -309,29 +437,156 @@ TransactionList<KEY_PAIR, HASHER>::from_json(json const &j)
 
 template TransactionList<> TransactionList<>::from_json(json const &data);
 
+template<typename KEY_PAIR, typename HASHER>
+typename TransactionUnspentOutputs<KEY_PAIR, HASHER>::unspent_output const *
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::find(outpoint const &o) const
+{
+  if (auto it { m_index.find(o) }; it != m_index.end())
+    return &*it->second;
+
+  if (!m_base || m_spent_base.contains(o))
+    return nullptr;
+
+  return m_base->find(o);
+}
+
+template typename TransactionUnspentOutputs<>::unspent_output const *
+TransactionUnspentOutputs<>::find(outpoint const &o) const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::list<typename TransactionUnspentOutputs<KEY_PAIR, HASHER>::unspent_output>
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::resolve(transaction const &t) const
+{
+  std::list<unspent_output> unspent_outputs;
+
+  for (auto const &txi : t.inputs()) {
+    if (auto utxo { find(txi.outpoint()) })
+      unspent_outputs.push_back(*utxo);
+  }
+
+  return unspent_outputs;
+}
+
+template std::list<typename TransactionUnspentOutputs<>::unspent_output>
+TransactionUnspentOutputs<>::resolve(transaction const &t) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::link(transaction_list &ts) const
+{
+  // Transactions may spend outputs of transactions preceding them in the same
+  // list but no output may be spent twice.
+  std::unordered_map<outpoint, unspent_output, typename outpoint::hash> created;
+  std::unordered_set<outpoint, typename outpoint::hash> spent;
+
+  for (auto &t : ts.get()) {
+    std::list<unspent_output> unspent_outputs;
+
+    for (auto const &txi : t.inputs()) {
+      auto o { txi.outpoint() };
+
+      if (!spent.insert(o).second)
+        continue;
+
+      if (auto utxo { find(o) })
+        unspent_outputs.push_back(*utxo);
+      else if (auto it { created.find(o) }; it != created.end())
+        unspent_outputs.push_back(it->second);
+    }
+
+    t.update_unspent_outputs(std::move(unspent_outputs));
+
+    auto const &outputs { t.outputs() };
+
+    for (std::size_t i { 0 }; i < outputs.size(); ++i)
+      created.emplace(outpoint { t.hash(), i }, unspent_output { t.hash(), i, outputs[i] });
+  }
+}
+
+template void TransactionUnspentOutputs<>::link(transaction_list &ts) const;
+
 template<typename KEY_PAIR, typename HASHER>
 void
-TransactionUnspentOutputs<KEY_PAIR, HASHER>::update(transaction const &t)
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::update(transaction const &t,
+                                                    spent_outputs *spent)
 {
   auto const &hash { t.hash() };
-  auto const &inputs { t.inputs() };
   auto const &outputs { t.outputs() };
 
   for (std::size_t i { 0 }; i < outputs.size(); ++i)
-    m_unspent_outputs.emplace_back(hash, i, outputs[i]);
+    insert(unspent_output { hash, i, outputs[i] }, std::nullopt);
 
-  for (auto const &txi : inputs) {
-    for (auto it { m_unspent_outputs.begin() }; it != m_unspent_outputs.end(); ++it) {
-      if (it->output_hash == txi.output_hash &&
-          it->output_index == txi.output_index) {
+  for (auto const &txi : t.inputs())
+    erase(txi.outpoint(), spent);
+}
 
-        it = m_unspent_outputs.erase(it);
-      }
-    }
+template void TransactionUnspentOutputs<>::update(transaction const &t,
+                                                  spent_outputs *spent);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::revert(transaction const &t,
+                                                    spent_outputs const &spent)
+{
+  for (auto it { spent.rbegin() }; it != spent.rend(); ++it)
+    insert(it->first, it->second);
+
+  for (std::size_t i { 0 }; i < t.outputs().size(); ++i)
+    erase(outpoint { t.hash(), i }, nullptr);
+}
+
+template void TransactionUnspentOutputs<>::revert(transaction const &t,
+                                                  spent_outputs const &spent);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::insert(unspent_output utxo,
+                                                    std::optional<outpoint> const &next)
+{
+  auto o { utxo.outpoint() };
+
+  // Outputs of the base only have to be unhidden.
+  if (m_spent_base.erase(o))
+    return;
+
+  auto pos { m_unspent_outputs.end() };
+
+  if (next) {
+    if (auto it { m_index.find(*next) }; it != m_index.end())
+      pos = it->second;
   }
+
+  m_index[o] = m_unspent_outputs.insert(pos, std::move(utxo));
 }
 
-template void TransactionUnspentOutputs<>::update(transaction const &t);
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnspentOutputs<KEY_PAIR, HASHER>::erase(outpoint const &o, spent_outputs *spent)
+{
+  if (auto it { m_index.find(o) }; it != m_index.end()) {
+    if (spent) {
+      auto next { std::next(it->second) };
+
+      spent->emplace_back(*it->second, next == m_unspent_outputs.end()
+                                         ? std::nullopt
+                                         : std::optional { next->outpoint() });
+    }
+
+    m_unspent_outputs.erase(it->second);
+    m_index.erase(it);
+    return;
+  }
+
+  if (!m_base || m_spent_base.contains(o))
+    return;
+
+  if (auto utxo { m_base->find(o) }) {
+    if (spent)
+      spent->emplace_back(*utxo, std::nullopt);
+
+    m_spent_base.insert(o);
+  }
+}
 
 template<typename KEY_PAIR, typename HASHER>
 json
@@ -347,42 +602,275 @@ TransactionUnspentOutputs<KEY_PAIR, HASHER>::to_json() const
 template json TransactionUnspentOutputs<>::to_json() const;
 
 template<typename KEY_PAIR, typename HASHER>
-Transaction<KEY_PAIR, HASHER>
-TransactionUnconfirmedPool<KEY_PAIR, HASHER>::next()
+std::pair<bool, std::string>
+TransactionChainValidator<KEY_PAIR, HASHER>::operator()(transaction_list &ts, uint64_t index)
 {
-  auto t { m_transactions.front() };
+  auto [valid, error] = ts.valid_stateless(index);
+
+  if (!valid)
+    return { false, error };
+
+  m_unspent_outputs.link(ts);
+
+  // Signatures are verified in parallel by finish.
+  std::tie(valid, error) = ts.valid_inputs(false);
 
-  m_transactions.pop_front();
+  if (!valid)
+    return { false, error };
+
+  // The blockchain has already matched the checkpoint block's hash at this
+  // point, so all blocks before it can be assumed valid.
+  if (!config().checkpoint_hash.empty() && index == config().checkpoint_height)
+    m_checkpoint_reached = true;
+
+  for (auto const &t : ts.get())
+    m_unspent_outputs.update(t);
 
-  return t;
+  return { true, "" };
 }
 
-template Transaction<> TransactionUnconfirmedPool<>::next();
+template std::pair<bool, std::string>
+TransactionChainValidator<>::operator()(transaction_list &ts, uint64_t index);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionChainValidator<KEY_PAIR, HASHER>::skip(transaction_list const &ts)
+{
+  for (auto const &t : ts.get())
+    m_unspent_outputs.update(t);
+}
+
+template void TransactionChainValidator<>::skip(transaction_list const &ts);
+
+template<typename KEY_PAIR, typename HASHER>
+std::vector<typename TransactionAddressIndex<KEY_PAIR, HASHER>::Entry>
+TransactionAddressIndex<KEY_PAIR, HASHER>::find(std::string const &address,
+                                                std::size_t cursor,
+                                                std::size_t limit) const
+{
+  auto address_ { Address::find(address) };
+  if (!address_)
+    return {};
+
+  auto it { m_entries.find(*address_) };
+  if (it == m_entries.end())
+    return {};
+
+  auto const &entries { it->second };
+
+  if (cursor >= entries.size())
+    return {};
+
+  auto first { entries.begin() + cursor };
+  auto last { first + std::min(limit, entries.size() - cursor) };
+
+  return { first, last };
+}
+
+template std::vector<TransactionAddressIndex<>::Entry>
+TransactionAddressIndex<>::find(std::string const &address,
+                                std::size_t cursor,
+                                std::size_t limit) const;
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionAddressIndex<KEY_PAIR, HASHER>::connect(transaction const &t,
+                                                   spent_outputs const &spent)
+{
+  for (auto const &address : addresses(t, spent))
+    m_entries[address].push_back({ t.hash(), t.index() });
+}
+
+template void TransactionAddressIndex<>::connect(
+  transaction const &t, spent_outputs const &spent);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionAddressIndex<KEY_PAIR, HASHER>::disconnect(transaction const &t,
+                                                      spent_outputs const &spent)
+{
+  for (auto const &address : addresses(t, spent)) {
+    auto it { m_entries.find(address) };
+    if (it == m_entries.end())
+      continue;
+
+    auto &entries { it->second };
+
+    if (!entries.empty() && entries.back().hash == t.hash())
+      entries.pop_back();
+
+    if (entries.empty())
+      m_entries.erase(it);
+  }
+}
+
+template void TransactionAddressIndex<>::disconnect(
+  transaction const &t, spent_outputs const &spent);
+
+template<typename KEY_PAIR, typename HASHER>
+std::vector<Address>
+TransactionAddressIndex<KEY_PAIR, HASHER>::addresses(transaction const &t,
+                                                     spent_outputs const &spent)
+{
+  std::vector<Address> addresses;
+
+  for (auto const &[utxo, next] : spent)
+    addresses.push_back(utxo.output.address);
+
+  for (auto const &txo : t.outputs())
+    addresses.emplace_back(txo.address);
+
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+  return addresses;
+}
+
+template<typename KEY_PAIR, typename HASHER>
+std::list<typename TransactionUnconfirmedPool<KEY_PAIR, HASHER>::unspent_output>
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::resolve(transaction const &t) const
+{
+  std::list<unspent_output> unspent_outputs;
+
+  for (auto const &txi : t.inputs()) {
+    auto it { m_by_hash.find(txi.output_hash) };
+    if (it == m_by_hash.end())
+      continue;
+
+    auto const &outputs { it->second->t.outputs() };
+    if (txi.output_index >= outputs.size())
+      continue;
+
+    if (m_by_outpoint.find(txi.outpoint()) != m_by_outpoint.end())
+      continue;
+
+    unspent_outputs.emplace_back(txi.output_hash, txi.output_index, outputs[txi.output_index]);
+  }
+
+  return unspent_outputs;
+}
+
+template std::list<typename TransactionUnconfirmedPool<>::unspent_output>
+TransactionUnconfirmedPool<>::resolve(transaction const &t) const;
+
+template<typename KEY_PAIR, typename HASHER>
+std::vector<Transaction<KEY_PAIR, HASHER>>
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::select(std::size_t n, std::size_t index)
+{
+  expire();
+
+  std::vector<transaction> ts;
+  std::unordered_set<Digest> selected;
+
+  // Entries are ordered such that parents precede their children.
+  for (auto it { m_entries.begin() }; it != m_entries.end() && ts.size() < n; ++it) {
+    if (it->t.index() != index)
+      continue;
+
+    bool parents_selected { std::all_of(
+      it->parents.begin(),
+      it->parents.end(),
+      [&](Digest const &parent){ return !contains(parent) || selected.contains(parent); }) };
+
+    if (!parents_selected)
+      continue;
+
+    ts.push_back(it->t);
+    selected.insert(it->t.hash());
+  }
+
+  return ts;
+}
+
+template std::vector<Transaction<>> TransactionUnconfirmedPool<>::select(std::size_t n,
+                                                                          std::size_t index);
 
 template<typename KEY_PAIR, typename HASHER>
 void
 TransactionUnconfirmedPool<KEY_PAIR, HASHER>::add(transaction const &t)
 {
-  if (m_transactions.size() == config().transaction_num_per_block)
-    throw std::runtime_error("transaction pool is already full");
+  expire();
 
-  auto [valid, error] = t.valid();
+  // Assumes that t has already been validated.
 
-  if (!valid)
+  if (contains(t.hash()))
     throw std::runtime_error(
-      fmt::format("attempted to add invalid transaction to pool: {}", error));
+      "attempted to add invalid transaction to pool: duplicate transaction");
 
-  for (auto const &t_ : m_transactions) {
-    for (auto const &txi : t.inputs()) {
-      for (auto const &txi_ : t_.inputs()) {
-        if (txi == txi_)
-          throw std::runtime_error(
-            "Attempted to add invalid transaction to pool: duplicate inputs");
+  std::vector<Digest> parents;
+
+  for (auto const &txi : t.inputs()) {
+    if (m_by_outpoint.find(txi.outpoint()) != m_by_outpoint.end())
+      throw std::runtime_error(
+        "attempted to add invalid transaction to pool: duplicate inputs");
+
+    if (contains(txi.output_hash) &&
+        std::find(parents.begin(), parents.end(), txi.output_hash) == parents.end()) {
+      parents.push_back(txi.output_hash);
+    }
+  }
+
+  auto size { t.size() };
+
+  if (size > config().transaction_pool_size_max)
+    throw std::runtime_error("transaction exceeds transaction pool capacity");
+
+  if (m_size_bytes + size > config().transaction_pool_size_max &&
+      config().transaction_pool_eviction == PoolEviction::REJECT) {
+    throw std::runtime_error("transaction pool is already full");
+  }
+
+  // Determine everything that has to be evicted, oldest transactions and
+  // their descendants first, before evicting anything, so that the pool is
+  // left unchanged if t's own parents would have to go.
+  std::vector<Digest> evicted;
+  std::unordered_set<Digest> evicted_set;
+  std::size_t freed { 0 };
+
+  for (auto it { m_entries.begin() };
+       it != m_entries.end() && m_size_bytes - freed + size > config().transaction_pool_size_max;
+       ++it) {
+
+    if (evicted_set.contains(it->t.hash()))
+      continue;
+
+    auto first { evicted.size() };
+
+    evicted.push_back(it->t.hash());
+    evicted_set.insert(it->t.hash());
+
+    for (auto i { first }; i < evicted.size(); ++i) {
+      auto const &entry { *m_by_hash[evicted[i]] };
+
+      freed += entry.size;
+
+      for (auto const &child : entry.children) {
+        if (evicted_set.insert(child).second)
+          evicted.push_back(child);
       }
     }
   }
 
-  m_transactions.push_back(t);
+  for (auto const &parent : parents) {
+    if (evicted_set.contains(parent))
+      throw std::runtime_error(
+        "attempted to add invalid transaction to pool: parent transaction would be evicted");
+  }
+
+  for (auto const &hash : evicted)
+    erase(m_by_hash[hash]);
+
+  auto it { m_entries.insert(m_entries.end(), { t, clock::now(), size, parents, {} }) };
+
+  m_size_bytes += size;
+
+  m_by_hash.emplace(it->t.hash(), it);
+
+  for (auto const &txi : it->t.inputs())
+    m_by_outpoint.emplace(txi.outpoint(), it);
+
+  for (auto const &parent : parents)
+    m_by_hash[parent]->children.push_back(it->t.hash());
 }
 
 template void TransactionUnconfirmedPool<>::add(transaction const &t);
@@ -391,45 +879,123 @@ template<typename KEY_PAIR, typename HASHER>
 void
 TransactionUnconfirmedPool<KEY_PAIR, HASHER>::remove(transaction const &t)
 {
-  for (auto it { m_transactions.begin() }; it != m_transactions.end(); ++it) {
-    if (it->hash() == t.hash())
-      it = m_transactions.erase(it);
-  }
+  // The transaction was confirmed, transactions depending on it stay pooled.
+  auto it { m_by_hash.find(t.hash()) };
+  if (it != m_by_hash.end())
+    erase(it->second);
 }
 
 template void TransactionUnconfirmedPool<>::remove(transaction const &t);
 
 template<typename KEY_PAIR, typename HASHER>
 void
-TransactionUnconfirmedPool<KEY_PAIR, HASHER>::prune(
-  std::list<typename transaction::unspent_output> const &unspent_outputs)
-{
-  for (auto it { m_transactions.begin() }; it != m_transactions.end(); ++it) {
-    for (auto const &txi : it->inputs()) {
-      bool txi_valid { false };
-      for (auto const &utxo : unspent_outputs) {
-        if (utxo == txi) {
-          txi_valid = true;
-          break;
-        }
-      }
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::prune(transaction const &t)
+{
+  for (auto const &txi : t.inputs()) {
+    auto it { m_by_outpoint.find(txi.outpoint()) };
+    if (it != m_by_outpoint.end())
+      evict(it->second);
+  }
+}
 
-      if (!txi_valid)
-        it = m_transactions.erase(it);
-    }
+template void TransactionUnconfirmedPool<>::prune(transaction const &t);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::prune_index(std::size_t index)
+{
+  std::vector<Digest> stale;
+
+  for (auto const &entry : m_entries) {
+    if (entry.t.index() < index)
+      stale.push_back(entry.t.hash());
+  }
+
+  // Evicting a transaction also evicts its descendants.
+  for (auto const &hash : stale) {
+    auto it { m_by_hash.find(hash) };
+    if (it != m_by_hash.end())
+      evict(it->second);
+  }
+}
+
+template void TransactionUnconfirmedPool<>::prune_index(std::size_t index);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::expire()
+{
+  auto expired { clock::now() - config().transaction_pool_expiry };
+
+  while (!m_entries.empty() && m_entries.front().added < expired)
+    evict(m_entries.begin());
+}
+
+template void TransactionUnconfirmedPool<>::expire();
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::erase(iterator it)
+{
+  auto const &hash { it->t.hash() };
+
+  auto unlink = [this, &hash](Digest const &other, auto member)
+  {
+    auto it_other { m_by_hash.find(other) };
+    if (it_other == m_by_hash.end())
+      return;
+
+    auto &hashes { (*it_other->second).*member };
+
+    hashes.erase(std::remove(hashes.begin(), hashes.end(), hash), hashes.end());
+  };
+
+  for (auto const &parent : it->parents)
+    unlink(parent, &Entry::children);
+
+  for (auto const &child : it->children)
+    unlink(child, &Entry::parents);
+
+  for (auto const &txi : it->t.inputs())
+    m_by_outpoint.erase(txi.outpoint());
+
+  m_by_hash.erase(hash);
+
+  m_size_bytes -= it->size;
+
+  m_entries.erase(it);
+}
+
+template void TransactionUnconfirmedPool<>::erase(iterator it);
+
+template<typename KEY_PAIR, typename HASHER>
+void
+TransactionUnconfirmedPool<KEY_PAIR, HASHER>::evict(iterator it)
+{
+  // Transactions depending on an evicted transaction can never be confirmed.
+  std::vector<Digest> evicted { it->t.hash() };
+
+  for (std::size_t i { 0 }; i < evicted.size(); ++i) {
+    for (auto const &child : m_by_hash[evicted[i]]->children)
+      evicted.push_back(child);
+  }
+
+  for (auto const &hash : evicted) {
+    auto it_evicted { m_by_hash.find(hash) };
+    if (it_evicted != m_by_hash.end())
+      erase(it_evicted->second);
   }
 }
 
-template void TransactionUnconfirmedPool<>::prune(
-  std::list<typename transaction::unspent_output> const &unspent_outputs);
+template void TransactionUnconfirmedPool<>::evict(iterator it);
 
 template<typename KEY_PAIR, typename HASHER>
 json
 TransactionUnconfirmedPool<KEY_PAIR, HASHER>::to_json() const
 {
   json j = json::array();
-  for (auto const &t : m_transactions)
-    j.push_back(t.to_json());
+  for (auto const &entry : m_entries)
+    j.push_back(entry.t.to_json());
 
   return j;
 }
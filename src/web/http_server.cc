@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <chrono>
 #include <cstdint>
 #include <iostream>
@@ -6,6 +8,7 @@
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <utility>
 
@@ -21,6 +24,31 @@
 using namespace boost::asio;
 using namespace boost::beast;
 
+namespace
+{
+
+std::string url_decode(std::string_view str)
+{
+  std::string decoded;
+
+  for (std::size_t i { 0 }; i < str.size(); ++i) {
+    if (str[i] == '%' && i + 2 < str.size() &&
+        std::isxdigit(static_cast<unsigned char>(str[i + 1])) &&
+        std::isxdigit(static_cast<unsigned char>(str[i + 2]))) {
+
+      decoded.push_back(static_cast<char>(std::stoi(std::string { str.substr(i + 1, 2) }, nullptr, 16)));
+      i += 2;
+
+    } else {
+      decoded.push_back(str[i]);
+    }
+  }
+
+  return decoded;
+}
+
+} // end namespace
+
 namespace bc {
 
 struct HTTPServer::Context
@@ -147,7 +175,7 @@ private:
         case http::status::ok:
           {
             result_content_type = "application/json";
-            result_data << answer;
+            result_data << json_dump(answer);
           }
           break;
         case http::status::not_found:
@@ -244,14 +272,52 @@ void HTTPServer::support(std::string const &target,
 std::pair<HTTPServer::status, json> HTTPServer::handle(
   std::string const &target,
   method const &method,
-  json const &data) const
+  json data) const
 {
+  std::string_view path { target };
+  std::string_view query;
+
+  if (auto pos { path.find('?') }; pos != std::string_view::npos) {
+    query = path.substr(pos + 1);
+    path = path.substr(0, pos);
+  }
+
+  json params = json::object();
+
+  while (!query.empty()) {
+    auto param { query.substr(0, query.find('&')) };
+
+    query.remove_prefix(std::min(query.size(), param.size() + 1));
+
+    auto pos { param.find('=') };
+    if (pos == std::string_view::npos)
+      params[url_decode(param)] = "";
+    else
+      params[url_decode(param.substr(0, pos))] = url_decode(param.substr(pos + 1));
+  }
+
   std::scoped_lock lock(m_handlers_mtx);
 
-  auto it { m_handlers.find(target) };
+  auto it { m_handlers.find(std::string { path }) };
+
+  if (it == m_handlers.end()) {
+    for (it = m_handlers.begin(); it != m_handlers.end(); ++it) {
+      if (match(it->first, path, params))
+        break;
+    }
+  }
+
   if (it == m_handlers.end())
     return { status::not_found, {} };
 
+  if (!params.empty()) {
+    if (data.is_null())
+      data = json::object();
+
+    if (data.is_object())
+      data.update(params);
+  }
+
   for (auto const &[method_, handler] : it->second) {
     if (method_ == method)
       return handler(data);
@@ -260,6 +326,44 @@ std::pair<HTTPServer::status, json> HTTPServer::handle(
   return { status::bad_request, {} };
 }
 
+bool HTTPServer::match(std::string_view pattern, std::string_view path, json &params)
+{
+  if (pattern.find('{') == std::string_view::npos)
+    return false;
+
+  json pattern_params = json::object();
+
+  for (;;) {
+    auto pattern_segment { pattern.substr(0, pattern.find('/', 1)) };
+    auto path_segment { path.substr(0, path.find('/', 1)) };
+
+    if (pattern_segment.empty() || path_segment.empty())
+      break;
+
+    if (pattern_segment.starts_with("/{") && pattern_segment.ends_with('}')) {
+      if (path_segment.size() < 2)
+        return false;
+
+      auto name { pattern_segment.substr(2, pattern_segment.size() - 3) };
+
+      pattern_params[std::string { name }] = url_decode(path_segment.substr(1));
+
+    } else if (pattern_segment != path_segment) {
+      return false;
+    }
+
+    pattern.remove_prefix(pattern_segment.size());
+    path.remove_prefix(path_segment.size());
+  }
+
+  if (!pattern.empty() || !path.empty())
+    return false;
+
+  params.update(pattern_params);
+
+  return true;
+}
+
 void HTTPServer::run() const
 {
   Connection::accept(this, m_context->ioc, m_context->acceptor);
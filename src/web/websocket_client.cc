@@ -2,8 +2,8 @@
 #include <cstdint>
 #include <functional>
 #include <future>
-#include <iostream>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <string>
 #include <utility>
@@ -61,14 +61,20 @@ public:
 
   ~Connection()
   {
-    m_stream.close(websocket::close_code::normal);
+    // The connection may already have been aborted.
+    error_code ec;
+    m_stream.close(websocket::close_code::normal, ec);
   }
 
-  void send(json request, callback cb)
+  // Set once a request failed, the stream can't be used anymore afterwards.
+  bool aborted() const
+  { return m_aborted; }
+
+  void send(json request, callback cb, std::optional<clock::TimeInterval> timeout)
   {
     auto this_ { shared_from_this() };
 
-    m_send_queue.emplace(std::move(request), std::move(cb));
+    m_send_queue.push({ json_dump(request), std::move(cb), timeout });
 
     if (m_send_queue.size() > 1)
       return;
@@ -77,29 +83,54 @@ public:
   }
 
 private:
+  struct Request
+  {
+    std::string data;
+    callback cb;
+    std::optional<clock::TimeInterval> timeout;
+  };
+
   void write()
   {
     auto this_ { shared_from_this() };
 
-    auto const &[request_, cb_] = m_send_queue.front();
+    auto const &request { m_send_queue.front() };
+
+    // Cancelling the pending write or read makes its handler fail the
+    // request, the expiry is checked since the timer may have expired just
+    // before being rearmed for the next request.
+    if (request.timeout) {
+      m_timer.expires_after(*request.timeout);
+
+      m_timer.async_wait(
+        [this_](error_code ec)
+        {
+          if (!ec && this_->m_timer.expiry() <= steady_timer::clock_type::now())
+            get_lowest_layer(this_->m_stream).cancel();
+        });
+    }
 
     m_stream.async_write(
-      buffer(request_.dump()),
-      [this_, cb_ = std::move(cb_)](error_code ec, std::size_t)
+      buffer(request.data),
+      [this_](error_code ec, std::size_t)
       {
-        if (ec)
-          std::cerr << ec.message() << std::endl;
-        else
-          this_->on_write(std::move(cb_));
+        this_->on_write(ec);
       });
   }
 
-  void on_write(callback cb)
+  void on_write(error_code ec)
   {
     auto this_ { shared_from_this() };
 
+    auto cb { std::move(m_send_queue.front().cb) };
+
     m_send_queue.pop();
 
+    if (ec) {
+      fail(std::move(cb), ec);
+      return;
+    }
+
     read(std::move(cb));
   }
 
@@ -112,7 +143,7 @@ private:
       [this_, cb = std::move(cb)](error_code ec, std::size_t)
       {
         if (ec)
-          std::cerr << ec.message() << std::endl;
+          this_->fail(std::move(cb), ec);
         else
           this_->on_read(std::move(cb));
       });
@@ -122,6 +153,8 @@ private:
   {
     auto this_ { shared_from_this() };
 
+    m_timer.cancel();
+
     auto buffer_data { buffers_to_string(m_buffer.data()) };
     m_buffer.consume(m_buffer.size());
 
@@ -153,12 +186,32 @@ private:
       write();
   }
 
+  // Queued requests are still sent, they fail right away if the connection
+  // has been aborted.
+  void fail(callback cb, error_code ec)
+  {
+    auto this_ { shared_from_this() };
+
+    m_aborted = true;
+
+    m_timer.cancel();
+
+    cb(false, ec.message());
+
+    if (!m_send_queue.empty())
+      write();
+  }
+
 private:
-  std::queue<std::pair<json, callback>> m_send_queue;
+  std::queue<Request> m_send_queue;
 
   websocket::stream<tcp_stream> m_stream;
 
+  steady_timer m_timer { m_stream.get_executor() };
+
   flat_buffer m_buffer;
+
+  bool m_aborted { false };
 };
 
 WebSocketClient::WebSocketClient(std::string const &host, uint16_t port)
@@ -197,9 +250,22 @@ std::pair<bool, std::string> WebSocketClient::send_sync(json const &request) con
   return { success, answer };
 }
 
-void WebSocketClient::send_async(json const &request, callback cb) const
+void WebSocketClient::send_async(json const &request,
+                                 callback cb,
+                                 std::optional<clock::TimeInterval> timeout) const
 {
-  m_connection->send(request, std::move(cb));
+  // Reconnect after a request failed or timed out.
+  if (m_connection->aborted()) {
+    try {
+      m_connection = std::make_shared<Connection>(*m_context);
+
+    } catch (std::exception const &e) {
+      cb(false, e.what());
+      return;
+    }
+  }
+
+  m_connection->send(request, std::move(cb), timeout);
 }
 
 void WebSocketClient::run() const
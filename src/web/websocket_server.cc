@@ -153,7 +153,7 @@ private:
     m_stream.text(true);
 
     m_stream.async_write(
-      buffer(response.dump()),
+      buffer(json_dump(response)),
       [this_](error_code ec, std::size_t)
       {
         if (ec)
@@ -74,6 +74,51 @@ class BlockchainTest(unittest.TestCase):
             assertBlockchainValues(self, node2.list_blocks(), ['first', 'second', 'third'])
             assertBlockchainValues(self, node3.list_blocks(), ['first', 'second', 'third'])
 
+    def test_query_block_ranges(self):
+        with run_nodes(num_nodes=1) as node:
+            for value in ['first', 'second', 'third', 'fourth']:
+                node.add_block(value)
+
+            blocks = node.list_block_range(start=1, stop=3)
+            self.assertEqual([b['data'] for b in blocks], ['second', 'third'])
+
+            blocks = node.list_block_range(start=2)
+            self.assertEqual([b['data'] for b in blocks], ['third', 'fourth'])
+
+            self.assertEqual(node.list_block_range(start=4), [])
+
+            block = node.get_block(3)
+            self.assertEqual(block['data'], 'fourth')
+
+            self.assertEqual(node.get_block_by_hash(block['hash']), block)
+
+    def test_batch_entries(self):
+        MAX_BATCH_LATENCY = 1.5
+
+        with run_nodes(num_nodes=1) as node:
+            ids = [e['id'] for e in node.add_entries(['first', 'second', 'second'])]
+
+            self.assertEqual(len(set(ids)), 3)
+
+            for entry_id in ids:
+                self.assertEqual(node.get_entry(entry_id)['status'], 'pending')
+
+            time.sleep(MAX_BATCH_LATENCY)
+
+            blocks = node.list_blocks()
+
+            assertBlockchainValid(self, blocks, 1)
+
+            self.assertEqual([b.data()['entries'] for b in blocks.all_blocks()],
+                             [['first', 'second', 'second']])
+
+            for position, entry_id in enumerate(ids):
+                entry = node.get_entry(entry_id)
+
+                self.assertEqual(entry['status'], 'confirmed')
+                self.assertEqual(entry['block_index'], 0)
+                self.assertEqual(entry['position'], position)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -1,4 +1,5 @@
 from unittest import TestCase, main
+import time
 import toml
 
 from bc import ECSecp256k1PrivateKey, SHA256Hasher
@@ -16,6 +17,7 @@ EC_PUBLIC_KEY2 = "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAEzZAc8y92btejhFwuZfUvYNUjWIQUtP
 
 class TransactionTest(TestCase):
     CONFIG = 'config/transactions_test.toml'
+    PRODUCER_CONFIG = 'config/producer_test.toml'
 
     @classmethod
     def setUpClass(cls):
@@ -103,6 +105,332 @@ class TransactionTest(TestCase):
                 unconfirmed = node.list_unconfirmed_transactions()
                 self.assertEqual(len(unconfirmed), 0)
 
+    def test_chained_transactions(self):
+        with run_nodes(num_nodes=2, config=self.CONFIG, with_transactions=True) as (node1, node2):
+            node1.add_peer(node2)
+
+            node1.add_block(data=EC_PUBLIC_KEY1)
+
+            utxos = utxos_initial = node1.list_unspent_transactions()
+
+            # Spend the reward and then spend the change while unconfirmed
+            tx1 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 1,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': utxos[0]['output_hash'],
+                            'output_index': utxos[0]['output_index'],
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY1
+                        },
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY2
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            tx2 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 2,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': tx1['hash'],
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY2
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            node1.add_transaction(tx1)
+            node1.add_transaction(tx2)
+
+            for node in node1, node2:
+                unconfirmed = node.list_unconfirmed_transactions()
+                self.assertListEqual(unconfirmed, [tx1, tx2])
+
+            # Only one transaction fits into a block, the parent goes first
+            node1.add_block(EC_PUBLIC_KEY2)
+
+            for node in node1, node2:
+                unconfirmed = node.list_unconfirmed_transactions()
+                self.assertListEqual(unconfirmed, [tx2])
+
+                self.assertEqual(node.get_transaction(tx2['hash'])['confirmations'], 0)
+
+            node1.add_block(EC_PUBLIC_KEY2)
+
+            for node in node1, node2:
+                unconfirmed = node.list_unconfirmed_transactions()
+                self.assertEqual(len(unconfirmed), 0)
+
+                confirmed = node.get_transaction(tx1['hash'])
+                self.assertEqual(confirmed['transaction'], tx1)
+                self.assertEqual(confirmed['block_index'], 1)
+                self.assertEqual(confirmed['confirmations'], 2)
+
+                # The first address received the reward and sent tx1 and tx2
+                history = node.list_address_transactions(EC_PUBLIC_KEY1, limit=2)
+                self.assertListEqual(
+                    [t['transaction']['hash'] for t in history['transactions']],
+                    [utxos_initial[0]['output_hash'], tx1['hash']])
+
+                history = node.list_address_transactions(
+                    EC_PUBLIC_KEY1, cursor=history['next_cursor'], limit=2)
+                self.assertListEqual(
+                    [t['transaction']['hash'] for t in history['transactions']],
+                    [tx2['hash']])
+                self.assertIsNone(history['next_cursor'])
+
+                utxos = node.list_unspent_transactions()
+                self.assertEqual(
+                    sum(utxo['output']['amount'] for utxo in utxos
+                        if utxo['output']['address'] == EC_PUBLIC_KEY2),
+                    3 * self._reward_amount)
+
+    def test_batch_transactions(self):
+        with run_nodes(num_nodes=2, config=self.CONFIG, with_transactions=True) as (node1, node2):
+            node1.add_peer(node2)
+
+            node1.add_block(data=EC_PUBLIC_KEY1)
+
+            utxos = node1.list_unspent_transactions()
+
+            tx1 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 1,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': utxos[0]['output_hash'],
+                            'output_index': utxos[0]['output_index'],
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY1
+                        },
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY2
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            # Spends an output that doesn't exist
+            tx_invalid = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 1,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': '0' * 64,
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount,
+                            'address': EC_PUBLIC_KEY2
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            # Spends an output of another transaction in the same batch
+            tx2 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 2,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': tx1['hash'],
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount // 2,
+                            'address': EC_PUBLIC_KEY2
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            results = node1.add_transactions([tx1, tx_invalid, tx2])
+
+            self.assertListEqual(
+                [result['status'] for result in results], ['ok', 'not ok', 'ok'])
+            self.assertEqual(results[0]['hash'], tx1['hash'])
+            self.assertIn('error', results[1])
+            self.assertEqual(results[2]['hash'], tx2['hash'])
+
+            # Only the transactions that were added are propagated
+            for node in node1, node2:
+                unconfirmed = node.list_unconfirmed_transactions()
+                self.assertListEqual(unconfirmed, [tx1, tx2])
+
+    def test_produce_blocks(self):
+        config = toml.load(self.PRODUCER_CONFIG)
+
+        latency_max = config['producer']['latency_max'] / 1000
+
+        with run_nodes(num_nodes=1, config=self.PRODUCER_CONFIG, with_transactions=True) as node:
+            node.add_block(data=EC_PUBLIC_KEY1)
+
+            utxos = node.list_unspent_transactions()
+
+            tx1 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 1,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': utxos[0]['output_hash'],
+                            'output_index': utxos[0]['output_index'],
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount,
+                            'address': EC_PUBLIC_KEY1
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            tx2 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 1,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': tx1['hash'],
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount,
+                            'address': EC_PUBLIC_KEY1
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            tx3 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 2,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': tx2['hash'],
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount,
+                            'address': EC_PUBLIC_KEY1
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            # Reaching the fill threshold produces a block right away
+            results = node.add_transactions([tx1, tx2])
+            self.assertListEqual([result['status'] for result in results], ['ok', 'ok'])
+
+            time.sleep(latency_max / 4)
+
+            self.assertEqual(len(node.list_block_range()), 2)
+            self.assertEqual(len(node.list_unconfirmed_transactions()), 0)
+
+            for t in tx1, tx2:
+                self.assertEqual(node.get_transaction(t['hash'])['block_index'], 1)
+
+            # A single transaction waits for the maximum latency
+            node.add_transaction(tx3)
+
+            time.sleep(latency_max / 4)
+
+            self.assertEqual(len(node.list_block_range()), 2)
+            self.assertListEqual(node.list_unconfirmed_transactions(), [tx3])
+
+            time.sleep(latency_max)
+
+            self.assertEqual(len(node.list_block_range()), 3)
+            self.assertEqual(len(node.list_unconfirmed_transactions()), 0)
+            self.assertEqual(node.get_transaction(tx3['hash'])['block_index'], 2)
+
+            # Transactions for later blocks don't produce blocks without them
+            tx4 = self._create_transaction(
+                {
+                    'type': 'standard',
+                    'index': 5,
+                    'hash': None,
+                    'inputs': [
+                        {
+                            'output_hash': tx3['hash'],
+                            'output_index': 0,
+                            'signature': None
+                        }
+                    ],
+                    'outputs': [
+                        {
+                            'amount': self._reward_amount,
+                            'address': EC_PUBLIC_KEY1
+                        }
+                    ]
+                },
+                key=EC_PRIVATE_KEY1)
+
+            node.add_transaction(tx4)
+
+            time.sleep(2 * latency_max)
+
+            self.assertEqual(len(node.list_block_range()), 3)
+            self.assertListEqual(node.list_unconfirmed_transactions(), [tx4])
+
+            # Rewards go to the configured address
+            utxos = node.list_unspent_transactions()
+            self.assertEqual(
+                sum(utxo['output']['amount'] for utxo in utxos
+                    if utxo['output']['address'] == config['producer']['reward_address']),
+                2 * self._reward_amount)
+
     @classmethod
     def _create_transaction(cls, t, key):
         cls._hash_transaction(t)
@@ -3,6 +3,7 @@ import os
 import requests
 import subprocess
 import time
+import urllib.parse
 
 import bc
 
@@ -69,6 +70,18 @@ class Node:
     def list_blocks(self):
         return bc.Blockchain.from_json(self._api_call('blocks', 'get'))
 
+    def list_block_range(self, start=None, stop=None):
+        params = urllib.parse.urlencode(
+            {k: v for k, v in (('from', start), ('to', stop)) if v is not None})
+
+        return self._api_call(f'blocks?{params}', 'get')
+
+    def get_block(self, index):
+        return self._api_call(f'blocks/{index}', 'get')
+
+    def get_block_by_hash(self, block_hash):
+        return self._api_call(f'blocks/hash/{block_hash}', 'get')
+
     def add_peer(self, node):
         data = {
             'host': node._websocket_host,
@@ -80,9 +93,29 @@ class Node:
     def list_peers(self):
         return self._api_call('peers', 'get')
 
+    def add_entries(self, entries):
+        return self._api_call('entries', 'post', data=entries)
+
+    def get_entry(self, entry_id):
+        return self._api_call(f'entries/{entry_id}', 'get')
+
     def add_transaction(self, transaction):
         return self._api_call('transactions', 'post', data=transaction)
 
+    def add_transactions(self, transactions):
+        return self._api_call('transactions/batch', 'post', data=transactions)
+
+    def get_transaction(self, transaction_hash):
+        return self._api_call(f'transactions/{transaction_hash}', 'get')
+
+    def list_address_transactions(self, address, cursor=None, limit=None):
+        address = urllib.parse.quote(address, safe='')
+
+        params = urllib.parse.urlencode(
+            {k: v for k, v in (('cursor', cursor), ('limit', limit)) if v is not None})
+
+        return self._api_call(f'addresses/{address}/transactions?{params}', 'get')
+
     def list_unconfirmed_transactions(self):
         return self._api_call('transactions/unconfirmed', 'get')
 
@@ -0,0 +1,60 @@
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "address.h"
+
+using namespace bc;
+
+TEST_CASE("address_test", "[address]")
+{
+  SECTION("address interning")
+  {
+    Address a1 { std::string { "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAE/a+b=" } };
+    Address a2 { std::string { "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAE/a+b=" } };
+    Address b { std::string { "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAE/c+d=" } };
+
+    CHECK(a1 == a2);
+    CHECK(a1.id() == a2.id());
+    CHECK(a1 != b);
+
+    CHECK(a1.to_string() == "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAE/a+b=");
+    CHECK(b.to_string() == "MFYwEAYHKoZIzj0CAQYFK4EEAAoDQgAE/c+d=");
+  }
+
+  SECTION("address lookup")
+  {
+    auto size { AddressTable::instance().size() };
+
+    CHECK(!Address::find("unknown"));
+    CHECK(AddressTable::instance().size() == size);
+
+    Address a { std::string { "known" } };
+
+    CHECK(Address::find("known") == a);
+  }
+
+  SECTION("concurrent address interning")
+  {
+    std::vector<std::vector<uint32_t>> ids(4);
+    std::vector<std::thread> threads;
+
+    for (std::size_t i { 0 }; i < ids.size(); ++i) {
+      threads.emplace_back([&ids, i]{
+        for (std::size_t j { 0 }; j < 1000; ++j)
+          ids[i].push_back(Address { "address-" + std::to_string(j) }.id());
+      });
+    }
+
+    for (auto &thread : threads)
+      thread.join();
+
+    for (std::size_t i { 1 }; i < ids.size(); ++i)
+      CHECK(ids[i] == ids[0]);
+  }
+}
@@ -0,0 +1,123 @@
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "block_store.h"
+#include "blockchain.h"
+#include "config.h"
+#include "text.h"
+
+using namespace bc;
+
+TEST_CASE("block_store_test", "[block_store]")
+{
+  using block = Block<Text>;
+  using block_store = BlockStore<block>;
+
+  auto dir { std::filesystem::temp_directory_path() / "block_store_test" };
+
+  std::filesystem::remove_all(dir);
+
+  // Force several segments.
+  config().store_segment_size_max = 512;
+
+  std::vector<block> blocks;
+  blocks.reserve(20);
+
+  blocks.emplace_back(Text { "block 0" });
+
+  for (std::size_t i { 1 }; i < 20; ++i)
+    blocks.emplace_back(Text { "block " + std::to_string(i) }, blocks.back());
+
+  auto check_blocks = [&](block_store const &store, std::size_t n)
+  {
+    REQUIRE(store.size() == n);
+
+    for (std::size_t i { 0 }; i < n; ++i) {
+      INFO("Block " << i);
+      CHECK(store.read(i).to_json() == blocks[i].to_json());
+      CHECK(store.find(blocks[i].hash()) == i);
+    }
+  };
+
+  {
+    block_store store { dir };
+
+    for (auto const &b : blocks)
+      store.append(b);
+
+    check_blocks(store, blocks.size());
+
+    CHECK_THROWS(store.append(blocks.front()));
+  }
+
+  SECTION("reopen")
+  {
+    block_store store { dir };
+
+    check_blocks(store, blocks.size());
+  }
+
+  SECTION("for each")
+  {
+    block_store store { dir };
+
+    std::vector<block> blocks_read;
+
+    store.for_each([&](block b){ blocks_read.push_back(std::move(b)); });
+
+    REQUIRE(blocks_read.size() == blocks.size());
+
+    for (std::size_t i { 0 }; i < blocks.size(); ++i) {
+      INFO("Block " << i);
+      CHECK(blocks_read[i].to_json() == blocks[i].to_json());
+    }
+  }
+
+  SECTION("truncate")
+  {
+    {
+      block_store store { dir };
+
+      store.truncate(5);
+
+      check_blocks(store, 5);
+      CHECK(!store.find(blocks[5].hash()));
+
+      store.append(blocks[5]);
+
+      check_blocks(store, 6);
+    }
+
+    block_store store { dir };
+
+    check_blocks(store, 6);
+  }
+
+  SECTION("incomplete record")
+  {
+    std::filesystem::path last;
+    for (auto const &entry : std::filesystem::directory_iterator { dir }) {
+      if (last.empty() || entry.path() > last)
+        last = entry.path();
+    }
+
+    std::filesystem::resize_file(last, std::filesystem::file_size(last) - 1);
+
+    block_store store { dir };
+
+    check_blocks(store, blocks.size() - 1);
+
+    store.append(blocks.back());
+
+    check_blocks(store, blocks.size());
+  }
+
+  std::filesystem::remove_all(dir);
+}
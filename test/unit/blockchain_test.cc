@@ -0,0 +1,212 @@
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include "blockchain.h"
+#include "config.h"
+#include "json.h"
+#include "text.h"
+
+using namespace bc;
+
+TEST_CASE("blockchain_test", "[blockchain]")
+{
+  using blockchain = Blockchain<Text>;
+
+  blockchain bchain;
+
+  for (std::size_t i { 0 }; i < 10; ++i)
+    bchain.construct_next_block(Text { "block " + std::to_string(i) });
+
+  auto str { bchain.to_json().dump() };
+
+  SECTION("serialized")
+  {
+    CHECK(json_dump(bchain.blocks_to_json(0, bchain.length())) == str);
+
+    json j;
+    j["blocks"] = bchain.blocks_to_json(3, 5);
+    j["block"] = bchain.block_to_json(bchain.block(7).hash());
+    j["missing"] = bchain.block_to_json(Digest {});
+
+    auto j_parsed = json::parse(json_dump(j));
+
+    CHECK(j_parsed["blocks"] == json { bchain.block(3).to_json(), bchain.block(4).to_json() });
+    CHECK(j_parsed["block"] == bchain.block(7).to_json());
+    CHECK(j_parsed["missing"].is_null());
+  }
+
+  SECTION("snapshot")
+  {
+    auto snapshot { bchain.snapshot() };
+    auto const &latest { snapshot->latest_block() };
+
+    // Cross a storage segment boundary without driving up the difficulty.
+    config().blockgen_difficulty_adjust_factor_limit = 1;
+
+    for (std::size_t i { 10 }; i < 260; ++i)
+      bchain.construct_next_block(Text { "block " + std::to_string(i) });
+
+    CHECK(snapshot->length() == 10);
+    CHECK(latest.to_json() == json::parse(str)[9]);
+    CHECK(bchain.block(9).hash() == latest.hash());
+    CHECK(bchain.valid().first);
+
+    auto j = bchain.to_json();
+    j.erase(j.begin() + 257, j.end());
+
+    auto fork { blockchain::from_json(j) };
+
+    for (std::size_t i { 257 }; i < 262; ++i)
+      fork.construct_next_block(Text { "fork block " + std::to_string(i) });
+
+    auto snapshot_replaced { bchain.snapshot() };
+
+    CHECK(bchain.replace_suffix(257, fork.blocks(257, 262)));
+    CHECK(bchain.to_json() == fork.to_json());
+
+    CHECK(snapshot_replaced->length() == 260);
+    CHECK(snapshot_replaced->block(258).data().get()[0] == "block 258");
+    CHECK(bchain.snapshot()->block(258).data().get()[0] == "fork block 258");
+
+    config().blockgen_difficulty_adjust_factor_limit = 16;
+  }
+
+  SECTION("parse")
+  {
+    auto bchain_parsed { blockchain::parse(str.begin(), str.end()) };
+
+    CHECK(bchain_parsed.to_json() == bchain.to_json());
+    CHECK(bchain_parsed.valid().first);
+  }
+
+  SECTION("parse invalid")
+  {
+    auto j = json::parse(str);
+    j[5]["data"] = "tampered";
+
+    auto str_invalid { j.dump() };
+
+    CHECK_THROWS_AS(blockchain::parse(str_invalid.begin(), str_invalid.end()),
+                    std::logic_error);
+  }
+
+  SECTION("unsupported version")
+  {
+    auto j = bchain.to_json();
+    j[0].erase("version");
+
+    CHECK_THROWS_AS(blockchain::from_json(j), std::logic_error);
+
+    auto j_header = bchain.headers(1, 2)[0].to_json();
+    j_header["version"] = 1;
+
+    CHECK_THROWS_AS(blockchain::header_type::from_json(j_header), std::logic_error);
+  }
+
+  SECTION("salted entries")
+  {
+    bchain.construct_next_block(Text { { "same", "same" }, { "a:0", "a:1" } });
+
+    auto first { bchain.find_item(Text::hash("same", "a:0")) };
+    auto second { bchain.find_item(Text::hash("same", "a:1")) };
+
+    REQUIRE(first);
+    REQUIRE(second);
+    CHECK(first->position == 0);
+    CHECK(second->position == 1);
+
+    auto parsed { blockchain::from_json(bchain.to_json()) };
+
+    CHECK(parsed.find_item(Text::hash("same", "a:1"))->position == 1);
+  }
+
+  SECTION("checkpoint")
+  {
+    auto j = bchain.to_json();
+
+    config().checkpoint_height = 5;
+
+    config().checkpoint_hash = j[5]["hash"].get<std::string>();
+    CHECK_NOTHROW(blockchain::from_json(j));
+
+    config().checkpoint_hash = j[6]["hash"].get<std::string>();
+    CHECK_THROWS_AS(blockchain::from_json(j), std::logic_error);
+
+    config().checkpoint_height = 0;
+    config().checkpoint_hash.clear();
+  }
+
+  SECTION("replace suffix")
+  {
+    auto j = bchain.to_json();
+    j.erase(j.begin() + 7, j.end());
+
+    auto fork { blockchain::from_json(j) };
+
+    for (std::size_t i { 7 }; i < 12; ++i)
+      fork.construct_next_block(Text { "fork block " + std::to_string(i) });
+
+    CHECK(!fork.replace_suffix(5, bchain.blocks(5, 10)));
+
+    auto fork_blocks { fork.blocks(5, 12) };
+
+    auto j_tampered = fork_blocks[3].to_json();
+    j_tampered["data"] = "tampered";
+
+    fork_blocks[3] = blockchain::value_type::from_json(j_tampered);
+
+    CHECK_THROWS_AS(bchain.replace_suffix(5, fork_blocks), std::logic_error);
+    CHECK(bchain.to_json().dump() == str);
+
+    auto dropped_hash { bchain.latest_block().hash() };
+
+    CHECK(bchain.replace_suffix(5, fork.blocks(5, 12)));
+    CHECK(bchain.to_json() == fork.to_json());
+    CHECK(bchain.valid().first);
+
+    CHECK(!bchain.find_block(dropped_hash));
+    CHECK(bchain.find_block(fork.latest_block().hash()) == 11);
+    CHECK(bchain.find_block(fork.block(3).hash()) == 3);
+  }
+
+  SECTION("header chain")
+  {
+    auto j = bchain.to_json();
+    j.erase(j.begin() + 7, j.end());
+
+    auto fork { blockchain::from_json(j) };
+
+    for (std::size_t i { 7 }; i < 12; ++i)
+      fork.construct_next_block(Text { "fork block " + std::to_string(i) });
+
+    auto headers { fork.headers(7, 12) };
+
+    REQUIRE(headers.size() == 5);
+
+    for (std::size_t i { 0 }; i < headers.size(); ++i) {
+      INFO("Header " << i);
+      CHECK(blockchain::header_type::from_json(headers[i].to_json()) == headers[i]);
+      CHECK(fork.blocks(7 + i, 8 + i)[0].header() == headers[i]);
+    }
+
+    CHECK(bchain.valid_header_chain(7, headers).first);
+    CHECK(bchain.preferable(7, headers));
+    CHECK(!bchain.valid_header_chain(6, headers).first);
+
+    auto j_tampered = headers[2].to_json();
+    j_tampered["nonce"] = j_tampered["nonce"].get<std::size_t>() + 1;
+
+    headers[2] = blockchain::header_type::from_json(j_tampered);
+
+    CHECK(!bchain.valid_header_chain(7, headers).first);
+    CHECK(!bchain.valid_header_chain(7, headers, 2).first);
+
+    // Headers before 'first' are assumed to have been validated already.
+    CHECK(bchain.valid_header_chain(7, headers, 3).first);
+  }
+}
@@ -33,6 +33,19 @@ TEST_CASE("digest_test", "[crypto]")
     CHECK(Digest::from_string(d_string) == d);
   }
 
+  SECTION("digest longer than inline storage")
+  {
+    std::string d_string;
+    for (std::size_t i { 0 }; i < 2 * Digest::INLINE_LENGTH + 8; ++i)
+      d_string += "a5";
+
+    auto d { Digest::from_string(d_string) };
+
+    CHECK(d.length() == 2 * Digest::INLINE_LENGTH + 8);
+    CHECK(d.to_string() == d_string);
+    CHECK(Digest { d.data(), d.length() } == d);
+  }
+
   SECTION("digest difficulty")
   {
     CHECK(Digest::from_string("8000").zero_prefix_length() == 0);
@@ -0,0 +1,55 @@
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "thread_pool.h"
+
+using namespace bc;
+
+TEST_CASE("thread_pool_test", "[thread_pool]")
+{
+  ThreadPool pool { 4 };
+
+  SECTION("parallel for")
+  {
+    for (std::size_t n : { 0, 1, 3, 4, 5, 1000 }) {
+      std::vector<int> visited(n, 0);
+
+      pool.parallel_for(n, [&visited](std::size_t i){ ++visited[i]; });
+
+      INFO("n = " << n);
+      CHECK(visited == std::vector<int>(n, 1));
+    }
+  }
+
+  SECTION("nested parallel for")
+  {
+    std::vector<std::vector<int>> visited(8, std::vector<int>(8, 0));
+
+    pool.parallel_for(8, [&pool, &visited](std::size_t i){
+      pool.parallel_for(8, [&visited, i](std::size_t j){ ++visited[i][j]; });
+    });
+
+    CHECK(visited == std::vector<std::vector<int>>(8, std::vector<int>(8, 1)));
+  }
+
+  SECTION("parallel for exception")
+  {
+    std::atomic<std::size_t> count { 0 };
+
+    auto func = [&count](std::size_t i){
+      ++count;
+
+      if (i == 42)
+        throw std::runtime_error("failed");
+    };
+
+    CHECK_THROWS_AS(pool.parallel_for(100, func), std::runtime_error);
+    CHECK(count > 0);
+  }
+}
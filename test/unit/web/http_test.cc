@@ -49,6 +49,11 @@ public:
                      [](json const &data)
                      { return std::make_pair(HTTPServer::status::ok, data); });
 
+    m_server.support("/items/{id}/parts/{part}",
+                     HTTPServer::method::get,
+                     [](json const &data)
+                     { return std::make_pair(HTTPServer::status::ok, data); });
+
     m_server.support("/echo-fail",
                      HTTPServer::method::post,
                      [](json const &data)
@@ -129,6 +134,28 @@ TEST_CASE_METHOD(HTTPServerFixture, "http_test", "[web]")
     CHECK(answer == "Invalid request method 'POST'");
   }
 
+  SECTION("target parameters")
+  {
+    auto [status, answer] = test_client.send_sync("/items/42/parts/a%2Fb?limit=10&cursor=",
+                                                  HTTPServer::method::get);
+
+    REQUIRE(status == HTTPServer::status::ok);
+
+    auto data = json::parse(answer);
+
+    CHECK(data["id"] == "42");
+    CHECK(data["part"] == "a/b");
+    CHECK(data["limit"] == "10");
+    CHECK(data["cursor"] == "");
+  }
+
+  SECTION("target parameters mismatch")
+  {
+    auto [status, _] = test_client.send_sync("/items/42/parts", HTTPServer::method::get);
+
+    CHECK(status == HTTPServer::status::not_found);
+  }
+
   // XXX Invalid content type.
 
   // XXX Malformed request.